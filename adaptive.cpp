@@ -0,0 +1,92 @@
+#include "template.h"
+
+// Adaptive sampling. Next to the accumulator, every pixel keeps the sum of the luminance of
+// its samples and of its square, from which follows the standard error of its average. The
+// screen is divided into ADAPTIVE_TILE x ADAPTIVE_TILE tiles; a tile stays active until the
+// error of each of its pixels is a small fraction of its brightness. Converged tiles are not
+// traced: their pixels keep their average. The samples they free up go to the active tiles,
+// which take several samples per frame, one per pass over the active pixels. The budget is
+// counted in time, not pixels: a converged sky pixel frees little time. The sky, which
+// has no variance at all, drops out after the first few frames; glass caustics and penumbrae
+// stay active much longer.
+
+static constexpr float ERROR_FLOOR = 0.05f;	// dark pixels may keep this much absolute error
+
+// -----------------------------------------------------------
+// Forget the statistics: every tile is active again
+// -----------------------------------------------------------
+void Renderer::ResetConvergence()
+{
+	tilesX = (SCRWIDTH + ADAPTIVE_TILE - 1) / ADAPTIVE_TILE, tilesY = (SCRHEIGHT + ADAPTIVE_TILE - 1) / ADAPTIVE_TILE;
+	if (!adaptiveSampling) { tileActive.clear(); return; }
+	moments.assign( SCRWIDTH * SCRHEIGHT, float2( 0 ) );
+	tileSamples.assign( tilesX * tilesY, 0 );
+	tileActive.assign( tilesX * tilesY, 1 );
+	sampleBudget = 0;
+}
+
+// -----------------------------------------------------------
+// Before rendering a frame: list the pixels of the active
+// tiles and divide the samples of a frame over them
+// -----------------------------------------------------------
+void Renderer::PlanSamples()
+{
+	const int N = SCRWIDTH * SCRHEIGHT;
+	if (adaptiveSampling != !tileActive.empty()) ResetConvergence();
+	if (!adaptiveSampling)
+	{
+		samplesPerPixel = 1, sampleWeight = 1, activeFraction = 1;
+		return;
+	}
+	activePixels.clear();
+	for (int y = 0; y < SCRHEIGHT; y++)
+	{
+		const uchar* active = &tileActive[(y / ADAPTIVE_TILE) * tilesX];
+		for (int x = 0; x < SCRWIDTH; x++) if (active[x / ADAPTIVE_TILE]) activePixels.push_back( x + y * SCRWIDTH );
+	}
+	const int count = (int)activePixels.size();
+	// as much time as a frame with every pixel active, at the recent cost of a sample; the
+	// fraction of a sample that is left carries over to the next frame
+	activeFraction = (float)count / N;
+	if (!count) { samplesPerPixel = 0; return; }
+	if (msPerSample > 0) sampleBudget = min( sampleBudget + frameMs / (count * msPerSample), (float)maxSamplesPerPixel );
+	samplesPerPixel = max( 1, (int)sampleBudget );
+	sampleBudget = max( 0.0f, sampleBudget - samplesPerPixel ), sampleWeight = 1.0f / samplesPerPixel;
+}
+
+// -----------------------------------------------------------
+// After rendering a frame that took 'ms' to trace: converged pixels
+// keep their average, and every tile is tested against the
+// threshold again, so that a changed threshold takes effect at once
+// -----------------------------------------------------------
+void Renderer::UpdateConvergence( const float ms )
+{
+	if (!adaptiveSampling) return;
+	const float traced = (float)activePixels.size() * samplesPerPixel;
+	if (traced > 0) msPerSample = msPerSample > 0 ? 0.9f * msPerSample + 0.1f * ms / traced : ms / traced;
+	if (activeFraction == 1) frameMs = frameMs > 0 ? 0.9f * frameMs + 0.1f * ms : ms;
+	// accumulator / sampleCount is unchanged if a skipped pixel adds its own average
+	const float grow = sampleCount > 1 ? (float)sampleCount / (sampleCount - 1) : 1.0f, invSampleCount = 1.0f / sampleCount;
+#pragma omp parallel for schedule(static)
+	for (int tile = 0; tile < tilesX * tilesY; tile++)
+	{
+		const int x0 = (tile % tilesX) * ADAPTIVE_TILE, y0 = (tile / tilesX) * ADAPTIVE_TILE;
+		const int x1 = min( x0 + ADAPTIVE_TILE, SCRWIDTH ), y1 = min( y0 + ADAPTIVE_TILE, SCRHEIGHT );
+		if (tileActive[tile]) tileSamples[tile] += samplesPerPixel;
+		else for (int y = y0; y < y1; y++) for (int x = x0; x < x1; x++)
+		{
+			// the screen too: the denoiser or reprojection may have drawn over it
+			const int idx = x + y * SCRWIDTH;
+			accumulator[idx] *= grow, screen->pixels[idx] = RGBF32_to_RGB8( accumulator[idx] * invSampleCount );
+		}
+		const uint n = tileSamples[tile];
+		bool converged = n >= (uint)adaptiveMinSamples;
+		for (int y = y0; y < y1 && converged; y++) for (int x = x0; x < x1; x++)
+		{
+			const float2 m = moments[x + y * SCRWIDTH] * (1.0f / n);
+			const float variance = max( 0.0f, m.y - m.x * m.x ) * n / (n - 1);
+			if (variance > sqrf( adaptiveThreshold * (m.x + ERROR_FLOOR) ) * n) { converged = false; break; }
+		}
+		tileActive[tile] = converged ? 0 : 1;
+	}
+}
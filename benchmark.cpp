@@ -0,0 +1,556 @@
+// Ray throughput benchmark. Loads a fixed set of scenes, renders them from fixed camera
+// paths and measures primary, shadow and bounce rays separately, so a change to one kind
+// of ray query shows up in its own number. Results go to stdout and to a JSON file, for
+// tracking over time. Built by CMakeLists.txt as voxpopuli_bench (defines HEADLESS and
+// BENCHMARK; the platform stubs are shared with template/headless.cpp).
+
+#include "template.h"
+#include <omp.h>
+#include <filesystem>
+
+#ifdef BENCHMARK
+
+// a canonical scene: a function that fills the world, and a camera path through it
+struct BenchScene
+{
+	string name;
+	std::function<void( Scene& )> build; // empty: keep the layout made by Scene::Scene
+	vector<float3> pos, target;	// path keyframes; views are spread evenly over the path
+};
+
+// per kind of ray: best time over the repetitions, summed over the views
+struct BenchResult
+{
+	double rays = 0, seconds = 0, steps = 0;
+	void Add( const double n, const double s, const double st ) { rays += n, seconds += s, steps += st; }
+	double MRays() const { return seconds > 0 ? rays / (seconds * 1e6) : 0; }
+	double StepsPerRay() const { return rays > 0 ? steps / rays : 0; }
+};
+
+enum { PRIMARY = 0, PRIMARY_PACKET, SHADOW, SHADOW_PACKET, BOUNCE, KIND_COUNT };
+static const char* kindName[KIND_COUNT] = { "primary", "primary_packet", "shadow", "shadow_packet", "bounce" };
+
+// keyframes on a circle around 'center', for orbiting cameras
+static void Orbit( BenchScene& s, const float3& center, const float radius, const float height, const int count = 8 )
+{
+	for (int i = 0; i <= count; i++)
+	{
+		const float a = i * TWOPI / count;
+		s.pos.push_back( center + float3( radius * sinf( a ), height, -radius * cosf( a ) ) );
+		s.target.push_back( center );
+	}
+}
+
+static vector<BenchScene> CanonicalScenes( const string& assetDir )
+{
+	vector<BenchScene> scenes;
+	// the interactive scene, as constructed by Scene::Scene
+	BenchScene def;
+	def.name = "default";
+	Orbit( def, float3( 0.5f, 0.2f, 0.5f ), 1.0f, 0.45f );
+	scenes.push_back( def );
+	// every voxel model in the asset folder, scaled to fit three quarters of the world
+	vector<string> assets;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator( assetDir, error ))
+		if (entry.path().extension() == ".bin") assets.push_back( entry.path().string() );
+	std::sort( assets.begin(), assets.end() );
+	for (const string& file : assets)
+	{
+		int3 size;
+		gzFile f = gzopen( file.c_str(), "rb" );
+		if (!f) continue;
+		const bool valid = Scene::ReadModelHeader( file, f, size );
+		gzclose( f );
+		if (!valid) continue;
+		Scene::ModelPlacement model;
+		model.file = file;
+		model.scale = WORLDSIZE * 0.75f / max( size.x, max( size.y, size.z ) );
+		model.position = make_int3( (int)(WORLDSIZE - size.x * model.scale) / 2, 0, (int)(WORLDSIZE - size.z * model.scale) / 2 );
+		BenchScene asset;
+		asset.name = std::filesystem::path( file ).stem().string();
+		asset.build = [model]( Scene& scene ) { if (!scene.LoadModel( model )) FatalError( "Could not load %s", model.file.c_str() ); };
+		Orbit( asset, float3( 0.5f, 0.25f, 0.5f ), 1.0f, 0.45f );
+		scenes.push_back( asset );
+	}
+	// noise cave: half of the world solid, with a tunnel for the camera. Short, incoherent
+	// rays through bricks that are nearly all occupied.
+	BenchScene cave;
+	cave.name = "cave";
+	for (int i = 0; i <= 4; i++)
+	{
+		const float s = i / 4.0f;
+		cave.pos.push_back( float3( 0.1f + 0.8f * s, 0.5f + 0.15f * sinf( s * 6 ), 0.5f + 0.2f * cosf( s * 5 ) ) );
+		cave.target.push_back( cave.pos.back() + float3( 1, 0.1f * sinf( s * 9 ), 0.3f * sinf( s * 4 ) ) );
+	}
+	cave.build = [path = cave.pos]( Scene& scene )
+	{
+		// threshold at the median, so that the fill rate does not depend on the noise range
+		vector<float> noise( WORLDSIZE * WORLDSIZE * WORLDSIZE );
+	#pragma omp parallel for schedule(static)
+		for (int i = 0; i < WORLDSIZE * WORLDSIZE * WORLDSIZE; i++)
+			noise[i] = noise3D( (float)(i % WORLDSIZE) / WORLDSIZE, (float)((i / WORLDSIZE) % WORLDSIZE) / WORLDSIZE, (float)(i / (WORLDSIZE * WORLDSIZE)) / WORLDSIZE );
+		vector<float> sorted = noise;
+		std::nth_element( sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end() );
+		const float threshold = sorted[sorted.size() / 2];
+		for (int z = 0, i = 0; z < WORLDSIZE; z++) for (int y = 0; y < WORLDSIZE; y++) for (int x = 0; x < WORLDSIZE; x++, i++)
+		{
+			if (noise[i] < threshold) continue;
+			// carve the tunnel: keep voxels near the path segments empty
+			const float3 P = (float3( (float)x, (float)y, (float)z ) + 0.5f) * (1.0f / WORLDSIZE);
+			bool tunnel = false;
+			for (size_t j = 0; j + 1 < path.size() && !tunnel; j++)
+			{
+				const float3 A = path[j], AB = path[j + 1] - A;
+				const float u = clamp( dot( P - A, AB ) / dot( AB, AB ), 0.0f, 1.0f );
+				tunnel = length( A + u * AB - P ) < 0.06f;
+			}
+			if (!tunnel) scene.Set( x, y, z, (x ^ y ^ z) & 4 ? MAT_LAMBERTIAN_GRAY : MAT_LAMBERTIAN_WHITE );
+		}
+	};
+	scenes.push_back( cave );
+	// mirror box: closed room with mirror walls; bounce rays never escape
+	BenchScene box;
+	box.name = "mirrorbox";
+	box.build = []( Scene& scene )
+	{
+		for (int a = 0; a < WORLDSIZE; a++) for (int b = 0; b < WORLDSIZE; b++)
+		{
+			scene.Set( 0, a, b, MAT_MIRROR ), scene.Set( WORLDSIZE - 1, a, b, MAT_MIRROR );
+			scene.Set( a, 0, b, MAT_LAMBERTIAN_WHITE ), scene.Set( a, WORLDSIZE - 1, b, MAT_MIRROR );
+			scene.Set( a, b, 0, MAT_MIRROR ), scene.Set( a, b, WORLDSIZE - 1, MAT_MIRROR );
+		}
+		const int3 cube[3] = { make_int3( 30, 1, 40 ), make_int3( 80, 1, 70 ), make_int3( 50, 1, 90 ) };
+		const uint mat[3] = { MAT_RED, MAT_GREEN, MAT_BLUE };
+		for (int i = 0; i < 3; i++)
+			for (int z = 0; z < 16; z++) for (int y = 0; y < 16; y++) for (int x = 0; x < 16; x++)
+				scene.Set( cube[i].x + x, cube[i].y + y, cube[i].z + z, mat[i] );
+	};
+	Orbit( box, float3( 0.5f, 0.4f, 0.5f ), 0.35f, 0.1f );
+	scenes.push_back( box );
+	// dust: one voxel in a hundred, so nearly every brick is occupied but rays travel far
+	BenchScene dust;
+	dust.name = "dust";
+	dust.build = []( Scene& scene )
+	{
+		uint seed = 0x12345;
+		for (int z = 0; z < WORLDSIZE; z++) for (int y = 0; y < WORLDSIZE; y++) for (int x = 0; x < WORLDSIZE; x++)
+			if (RandomFloat( seed ) < 0.01f) scene.Set( x, y, z, MAT_LAMBERTIAN_WHITE );
+	};
+	Orbit( dust, float3( 0.5f, 0.5f, 0.5f ), 0.9f, 0.3f );
+	scenes.push_back( dust );
+	return scenes;
+}
+
+// camera for view 'i' of 'count', interpolated along the keyframes
+static void SetView( Camera& camera, const BenchScene& s, const int i, const int count )
+{
+	const float f = count > 1 ? (float)i / (count - 1) * (s.pos.size() - 1) : 0;
+	const int k = min( (int)f, (int)s.pos.size() - 2 );
+	const float u = f - k;
+	camera.LookAt( lerp( s.pos[k], s.pos[k + 1], u ), lerp( s.target[k], s.target[k + 1], u ) );
+}
+
+// run 'job' 'repeat' times and return the fastest time, in seconds
+static double Best( const int repeat, const std::function<void()>& job )
+{
+	double best = 1e30;
+	for (int i = 0; i < repeat; i++)
+	{
+		Timer timer;
+		job();
+		best = min( best, (double)timer.elapsed() );
+	}
+	return best;
+}
+
+// a shadow ray towards the sun and one bounce ray for every primary hit; returns their number
+static int SecondaryRays( const Scene& scene, const vector<Ray>& hits, const float3& sunDir, vector<Ray>& shadow, vector<Ray>& bounce )
+{
+	int count = 0;
+	for (int i = 0; i < (int)hits.size(); i++)
+	{
+		const Ray& hit = hits[i];
+		if (hit.voxel == 0 || hit.voxel >= scene.materialCount) continue;
+		const float3 P = hit.IntersectionPoint(), Nrm = hit.GetNormal();
+		shadow[count] = Ray( P + Nrm * EPSILON, sunDir );
+		// mirrors reflect, everything else bounces diffusely; fixed seed per pixel
+		uint seed = InitSeed( i );
+		const float3 D = scene.materials[hit.voxel].type == MaterialType::Metal ? reflect( hit.D, Nrm ) : cosineweighteddiffusereflection( Nrm, seed );
+		bounce[count++] = Ray( P + Nrm * EPSILON, normalize( D ) );
+	}
+	return count;
+}
+
+// measure one view: primary rays through pixel centers, then a shadow ray towards the sun
+// and one bounce ray for every primary hit. Every query gets a fresh copy of its rays.
+static void BenchView( const Scene& scene, Camera& camera, const float3& sunDir, const int repeat, BenchResult* result )
+{
+	const int N = SCRWIDTH * SCRHEIGHT;
+	static const Ray none( float3( 0 ), float3( 0, 0, 1 ) );
+	static vector<Ray> primary( N, none ), hits( N, none ), shadow( N, none ), bounce( N, none );
+	for (int y = 0; y < SCRHEIGHT; y++) for (int x = 0; x < SCRWIDTH; x++)
+		primary[x + y * SCRWIDTH] = camera.GetPrimaryRay( x + 0.5f, y + 0.5f );
+	// primary rays, one by one
+	uint64_t steps = 0;
+	double seconds = Best( repeat, [&]() {
+		steps = 0;
+	#pragma omp parallel for schedule(dynamic, 256) reduction(+:steps)
+		for (int i = 0; i < N; i++)
+		{
+			Ray ray = primary[i];
+			scene.FindNearest( ray );
+			hits[i] = ray, steps += ray.steps;
+		}
+	} );
+	result[PRIMARY].Add( N, seconds, (double)steps );
+	// primary rays, 8-wide packets of horizontally adjacent pixels
+	if (CPUCaps::HW_AVX2)
+	{
+		seconds = Best( repeat, [&]() {
+			steps = 0;
+		#pragma omp parallel for schedule(dynamic, 32) reduction(+:steps)
+			for (int i = 0; i < N / 8; i++)
+			{
+				ALIGN( 32 ) float x[8], y[8];
+				for (int lane = 0; lane < 8; lane++) x[lane] = ((i * 8 + lane) % SCRWIDTH) + 0.5f, y[lane] = ((i * 8 + lane) / SCRWIDTH) + 0.5f;
+				RayPacket8 packet;
+				camera.GetPrimaryRays8( x, y, packet );
+				memset( packet.voxel, 0, 32 ), memset( packet.axis, 0, 32 );
+				scene.FindNearest8( packet );
+				for (int lane = 0; lane < 8; lane++) steps += packet.steps[lane];
+			}
+		} );
+		result[PRIMARY_PACKET].Add( N / 8 * 8, seconds, (double)steps );
+	}
+	// secondary rays start at the primary hits
+	const int count = SecondaryRays( scene, hits, sunDir, shadow, bounce );
+	std::atomic<int> occluded( 0 );
+	seconds = Best( repeat, [&]() {
+		steps = 0, occluded = 0;
+	#pragma omp parallel for schedule(dynamic, 256) reduction(+:steps)
+		for (int i = 0; i < count; i++)
+		{
+			Ray ray = shadow[i];
+			if (scene.IsOccluded( ray )) occluded++;
+			steps += ray.steps;
+		}
+	} );
+	result[SHADOW].Add( count, seconds, (double)steps );
+	// the same shadow rays, 8-wide packets in screen order; all share the sun direction
+	if (CPUCaps::HW_AVX2)
+	{
+		seconds = Best( repeat, [&]() {
+			steps = 0;
+		#pragma omp parallel for schedule(dynamic, 32) reduction(+:steps)
+			for (int i = 0; i < count / 8; i++)
+			{
+				RayPacket8 packet;
+				for (int lane = 0; lane < 8; lane++)
+				{
+					const Ray& ray = shadow[i * 8 + lane];
+					packet.Ox[lane] = ray.O.x, packet.Oy[lane] = ray.O.y, packet.Oz[lane] = ray.O.z;
+					packet.Dx[lane] = ray.D.x, packet.Dy[lane] = ray.D.y, packet.Dz[lane] = ray.D.z;
+					packet.t[lane] = ray.t;
+				}
+				scene.IsOccluded8( packet );
+				for (int lane = 0; lane < 8; lane++) steps += packet.steps[lane];
+			}
+		} );
+		result[SHADOW_PACKET].Add( count / 8 * 8, seconds, (double)steps );
+	}
+	seconds = Best( repeat, [&]() {
+		steps = 0;
+	#pragma omp parallel for schedule(dynamic, 256) reduction(+:steps)
+		for (int i = 0; i < count; i++)
+		{
+			Ray ray = bounce[i];
+			scene.FindNearest( ray );
+			steps += ray.steps;
+		}
+	} );
+	result[BOUNCE].Add( count, seconds, (double)steps );
+}
+
+// DDA microbenchmark: cycles per traversal step of the scalar brick map walk, the generic
+// loop against the one specialized on the ray octant (Scene::octantKernels), for the same
+// rays as BenchView. Single-threaded, so that a cycle count means something; per kind of
+// ray and walk, the fastest of 'repeat' runs counts.
+struct DDAResult
+{
+	double cycles[2] = {}, steps = 0; // per walk: generic, octant
+	double CyclesPerStep( const int walk ) const { return steps > 0 ? cycles[walk] / steps : 0; }
+};
+enum { DDA_PRIMARY = 0, DDA_SHADOW, DDA_BOUNCE, DDA_KINDS };
+static const char* ddaKindName[DDA_KINDS] = { "primary", "shadow", "bounce" };
+
+static void BenchDDA( Scene& scene, Camera& camera, const float3& sunDir, const int repeat, DDAResult* result )
+{
+	const int N = SCRWIDTH * SCRHEIGHT;
+	static const Ray none( float3( 0 ), float3( 0, 0, 1 ) );
+	static vector<Ray> primary( N, none ), hits( N, none ), shadow( N, none ), bounce( N, none );
+	for (int y = 0; y < SCRHEIGHT; y++) for (int x = 0; x < SCRWIDTH; x++)
+		primary[x + y * SCRWIDTH] = camera.GetPrimaryRay( x + 0.5f, y + 0.5f );
+	for (int i = 0; i < N; i++) hits[i] = primary[i], scene.FindNearest( hits[i] );
+	const int count = SecondaryRays( scene, hits, sunDir, shadow, bounce );
+	const vector<Ray>* rays[DDA_KINDS] = { &primary, &shadow, &bounce };
+	const int rayCount[DDA_KINDS] = { N, count, count };
+	for (int kind = 0; kind < DDA_KINDS; kind++) for (int walk = 0; walk < 2; walk++)
+	{
+		scene.octantKernels = walk != 0;
+		uint64_t best = ~0ull, steps = 0;
+		for (int r = 0; r < repeat; r++)
+		{
+			steps = 0;
+			const uint64_t start = __rdtsc();
+			for (int i = 0; i < rayCount[kind]; i++)
+			{
+				Ray ray = (*rays[kind])[i];
+				if (kind == DDA_SHADOW) scene.IsOccluded( ray ); else scene.FindNearest( ray );
+				steps += ray.steps;
+			}
+			best = std::min<uint64_t>( best, __rdtsc() - start );
+		}
+		result[kind].cycles[walk] += (double)best;
+		if (walk == 0) result[kind].steps += (double)steps;
+	}
+	scene.octantKernels = true;
+}
+
+// Memory layout benchmark: how many cache lines a primary ray touches with the brick map and
+// the bricks in scanline order and in Morton order (see VOXEL_LAYOUT in scene.h). Both layouts
+// are modelled in every build, whatever VOXEL_LAYOUT is; only the voxel contents come from the
+// scene. Hardware counters are not available everywhere, so the reads of the brick map walk
+// are replayed through a model of a 32KB, 8-way L1 data cache, ray after ray in screen order
+// as BenchView traces them, and counted per ray: distinct lines, and lines that missed the
+// cache. Views look along the x and z axes, and along two diagonals.
+enum { VIEW_AXIS = 0, VIEW_DIAGONAL, VIEW_CLASSES };
+static const char* viewClassName[VIEW_CLASSES] = { "axis", "diagonal" };
+struct CacheResult
+{
+	double rays = 0, lines[2] = {}, misses[2] = {}; // per layout: linear, Morton
+	double LinesPerRay( const int layout ) const { return rays > 0 ? lines[layout] / rays : 0; }
+	double MissesPerRay( const int layout ) const { return rays > 0 ? misses[layout] / rays : 0; }
+};
+
+// set-associative cache of 64-byte lines with LRU replacement
+struct CacheModel
+{
+	static constexpr int SETS = 64, WAYS = 8;
+	uint64_t tag[SETS][WAYS], stamp[SETS][WAYS], clock = 0, misses = 0;
+	CacheModel() { memset( tag, 0xff, sizeof( tag ) ), memset( stamp, 0, sizeof( stamp ) ); }
+	void Access( const uint64_t line )
+	{
+		uint64_t* t = tag[line % SETS], * s = stamp[line % SETS];
+		int victim = 0;
+		for (int w = 0; w < WAYS; w++)
+		{
+			if (t[w] == line) { s[w] = ++clock; return; }
+			if (s[w] < s[victim]) victim = w;
+		}
+		t[victim] = line, s[victim] = ++clock, misses++;
+	}
+};
+
+// index of cell x, y, z of a cube with 'size' cells per side, in either layout
+static uint LayoutIndex( const int layout, const uint x, const uint y, const uint z, const uint size )
+{
+	if (layout == LAYOUT_MORTON) return MortonSpread( x ) | (MortonSpread( y ) << 1) | (MortonSpread( z ) << 2);
+	return x + (y + z * size) * size;
+}
+
+// the cache lines the brick map walk reads for 'ray', per layout: the grid entry of every brick
+// it passes and, in occupied bricks, every voxel up to the hit. A voxel by voxel DDA passes the
+// same cells in the same order; grid and bricks are separate allocations, as in the Scene
+static void RayLines( const Scene& scene, const Ray& ray, vector<uint64_t>* lines )
+{
+	static constexpr uint64_t BRICK_BASE = 1ull << 32;
+	float tmin = 0, tmax = 1e34f;
+	for (int a = 0; a < 3; a++)
+	{
+		const float t0 = -ray.O[a] * ray.rD[a], t1 = (1 - ray.O[a]) * ray.rD[a];
+		tmin = max( tmin, min( t0, t1 ) ), tmax = min( tmax, max( t0, t1 ) );
+	}
+	if (!(tmin < tmax)) return;
+	const float3 P = (ray.O + (tmin + 0.00005f) * ray.D) * (float)WORLDSIZE;
+	int3 V = make_int3( clamp( (int)P.x, 0, WORLDSIZE - 1 ), clamp( (int)P.y, 0, WORLDSIZE - 1 ), clamp( (int)P.z, 0, WORLDSIZE - 1 ) ), step;
+	float3 tnext, tdelta;
+	for (int a = 0; a < 3; a++)
+	{
+		step[a] = ray.D[a] < 0 ? -1 : 1;
+		tdelta[a] = fabsf( ray.rD[a] ) * (1.0f / WORLDSIZE);
+		tnext[a] = ((float)(V[a] + (step[a] > 0)) * (1.0f / WORLDSIZE) - ray.O[a]) * ray.rD[a];
+	}
+	int3 lastBrick = make_int3( -1 );
+	while (true)
+	{
+		const int3 B = make_int3( V.x / BRICKSIZE, V.y / BRICKSIZE, V.z / BRICKSIZE );
+		const uint b = scene.grid[GridIndex( B.x, B.y, B.z )];
+		const bool entered = B.x != lastBrick.x || B.y != lastBrick.y || B.z != lastBrick.z;
+		lastBrick = B;
+		for (int layout = 0; layout < 2; layout++)
+		{
+			if (entered) lines[layout].push_back( LayoutIndex( layout, B.x, B.y, B.z, GRIDSIZE ) * sizeof( uint ) / 64 );
+			const uint local = LayoutIndex( layout, V.x & (BRICKSIZE - 1), V.y & (BRICKSIZE - 1), V.z & (BRICKSIZE - 1), BRICKSIZE );
+			if (b) lines[layout].push_back( (BRICK_BASE + ((uint64_t)(b - 1) * BRICKSIZE3 + local) * sizeof( Voxel )) / 64 );
+		}
+		if (b && scene.brick[(size_t)(b - 1) * BRICKSIZE3 + BrickOffset( V.x, V.y, V.z )]) return;
+		const int a = tnext.x < tnext.y ? (tnext.x < tnext.z ? 0 : 2) : (tnext.y < tnext.z ? 1 : 2);
+		V[a] += step[a], tnext[a] += tdelta[a];
+		if ((uint)V[a] >= WORLDSIZE) return;
+	}
+}
+
+static void BenchCache( const Scene& scene, Camera& camera, const BenchScene& s, CacheResult* result )
+{
+	// the camera stays as far from the center of the path as its first keyframe
+	const float3 center = s.target[0];
+	const float distance = length( s.pos[0] - center );
+	const float3 view[4] = { float3( 1, 0, 0 ), float3( 0, 0, 1 ), normalize( float3( 1, -0.8f, 1 ) ), normalize( float3( -1, -0.8f, 1 ) ) };
+	vector<uint64_t> lines[2];
+	for (int i = 0; i < 4; i++)
+	{
+		camera.LookAt( center - distance * view[i], center );
+		CacheResult& r = result[i < 2 ? VIEW_AXIS : VIEW_DIAGONAL];
+		CacheModel cache[2];
+		for (int y = 0; y < SCRHEIGHT; y++) for (int x = 0; x < SCRWIDTH; x++)
+		{
+			const Ray ray = camera.GetPrimaryRay( x + 0.5f, y + 0.5f );
+			lines[0].clear(), lines[1].clear();
+			RayLines( scene, ray, lines );
+			for (int layout = 0; layout < 2; layout++)
+			{
+				for (const uint64_t line : lines[layout]) cache[layout].Access( line );
+				std::sort( lines[layout].begin(), lines[layout].end() );
+				r.lines[layout] += (double)(std::unique( lines[layout].begin(), lines[layout].end() ) - lines[layout].begin());
+			}
+			r.rays++;
+		}
+		for (int layout = 0; layout < 2; layout++) r.misses[layout] += (double)cache[layout].misses;
+	}
+}
+
+static void Usage()
+{
+	printf( "usage: voxpopuli_bench [options]\n"
+		"  --scene NAME        only run this scene (repeatable); default: all\n"
+		"  --backend NAME      brickmap, tree64 or pyramid; default brickmap\n"
+		"  --views N           views per camera path, default 8\n"
+		"  --repeat N          runs per measurement, the fastest counts; default 3\n"
+		"  --json FILE         results file, default benchmark.json\n"
+		"  --assets DIR        folder with voxel models, one scene each; default assets\n"
+		"  --dda               DDA microbenchmark: cycles per step, generic against octant walk\n"
+		"  --cache             cache lines per primary ray, linear against Morton voxel layout\n"
+		"  --list              print the scene names and exit\n" );
+}
+
+// Application entry point
+int main( int argc, char** argv )
+{
+	// set fp flags: denormalize & flush to zero
+	_mm_setcsr( _mm_getcsr() | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON) );
+	const char* backendName[Scene::BACKEND_COUNT] = { "brickmap", "tree64", "pyramid" };
+	vector<string> only;
+	string assetDir = "assets";
+	bool list = false, dda = false, cache = false;
+	int views = 8, repeat = 3, backend = Scene::BRICKMAP;
+	const char* json = "benchmark.json";
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		const int left = argc - 1 - i;
+		if (arg == "--scene" && left >= 1) only.push_back( argv[++i] );
+		else if (arg == "--views" && left >= 1) views = max( 1, atoi( argv[++i] ) );
+		else if (arg == "--repeat" && left >= 1) repeat = max( 1, atoi( argv[++i] ) );
+		else if (arg == "--json" && left >= 1) json = argv[++i];
+		else if (arg == "--assets" && left >= 1) assetDir = argv[++i];
+		else if (arg == "--backend" && left >= 1)
+		{
+			const string name = argv[++i];
+			for (backend = 0; backend < Scene::BACKEND_COUNT && name != backendName[backend]; backend++);
+			if (backend == Scene::BACKEND_COUNT) { Usage(); return 1; }
+		}
+		else if (arg == "--list") list = true;
+		else if (arg == "--dda") dda = true;
+		else if (arg == "--cache") cache = true;
+		else { Usage(); return arg == "--help" ? 0 : 1; }
+	}
+	if (dda || cache) backend = Scene::BRICKMAP; // the walk they measure
+	const vector<BenchScene> scenes = CanonicalScenes( assetDir );
+	if (list) { for (const BenchScene& s : scenes) printf( "%s\n", s.name.c_str() ); return 0; }
+	// the sun of the interactive renderer (see Renderer::Init)
+	const float3 sunDir = normalize( -float3( 0.3f, -0.35f, 0.9f ) );
+	// one scene and camera for all runs; never deleted: the camera would overwrite camera.bin
+	Scene* scene = new Scene();
+	Camera* camera = new Camera();
+	FILE* f = fopen( json, "w" );
+	if (!f) FatalError( "Could not write %s", json );
+	fprintf( f, "{\n  \"resolution\": [%i, %i],\n  \"threads\": %i,\n  \"backend\": \"%s\",\n  \"views\": %i,\n  \"repeat\": %i,\n  \"scenes\": [",
+		SCRWIDTH, SCRHEIGHT, omp_get_max_threads(), backendName[backend], views, repeat );
+	if (dda) printf( "%-16s %13s %13s %13s   (cycles/step: generic, octant)\n", "scene", ddaKindName[0], ddaKindName[1], ddaKindName[2] );
+	else if (cache) printf( "%-16s %23s %23s   (lines, L1 misses per ray: linear/Morton)\n", "scene", viewClassName[0], viewClassName[1] );
+	else printf( "%-16s %10s %10s %10s %10s %10s   (Mrays/s, steps/ray)\n", "scene", kindName[0], "packet", kindName[2], "packet", kindName[4] );
+	bool first = true;
+	for (const BenchScene& s : scenes)
+	{
+		if (!only.empty() && std::find( only.begin(), only.end(), s.name ) == only.end()) continue;
+		// the default scene comes first, so it still has the layout of the constructor
+		Timer buildTimer;
+		if (s.build) scene->Clear(), s.build( *scene );
+		const float buildMs = buildTimer.elapsed() * 1000;
+		scene->backend = backend;
+		scene->Commit();
+		fprintf( f, "%s\n    { \"name\": \"%s\", \"bricks\": %u, \"build_ms\": %.1f", first ? "" : ",", s.name.c_str(), scene->brickCount - (uint)scene->freeBricks.size(), buildMs );
+		first = false;
+		if (dda)
+		{
+			DDAResult result[DDA_KINDS];
+			for (int i = 0; i < views; i++)
+			{
+				SetView( *camera, s, i, views );
+				BenchDDA( *scene, *camera, sunDir, repeat, result );
+			}
+			printf( "%-16s", s.name.c_str() );
+			for (int k = 0; k < DDA_KINDS; k++) printf( " %6.1f/%-6.1f", result[k].CyclesPerStep( 0 ), result[k].CyclesPerStep( 1 ) );
+			printf( "\n" );
+			for (int k = 0; k < DDA_KINDS; k++)
+				fprintf( f, ",\n      \"%s\": { \"steps\": %.0f, \"generic_cycles_per_step\": %.2f, \"octant_cycles_per_step\": %.2f }",
+					ddaKindName[k], result[k].steps, result[k].CyclesPerStep( 0 ), result[k].CyclesPerStep( 1 ) );
+			fprintf( f, " }" );
+			continue;
+		}
+		if (cache)
+		{
+			CacheResult result[VIEW_CLASSES];
+			BenchCache( *scene, *camera, s, result );
+			printf( "%-16s", s.name.c_str() );
+			for (int v = 0; v < VIEW_CLASSES; v++)
+				printf( " %5.1f/%-5.1f %5.2f/%-5.2f", result[v].LinesPerRay( 0 ), result[v].LinesPerRay( 1 ), result[v].MissesPerRay( 0 ), result[v].MissesPerRay( 1 ) );
+			printf( "\n" );
+			for (int v = 0; v < VIEW_CLASSES; v++)
+				fprintf( f, ",\n      \"%s\": { \"rays\": %.0f, \"linear_lines_per_ray\": %.3f, \"morton_lines_per_ray\": %.3f, \"linear_misses_per_ray\": %.4f, \"morton_misses_per_ray\": %.4f }",
+					viewClassName[v], result[v].rays, result[v].LinesPerRay( 0 ), result[v].LinesPerRay( 1 ), result[v].MissesPerRay( 0 ), result[v].MissesPerRay( 1 ) );
+			fprintf( f, " }" );
+			continue;
+		}
+		BenchResult result[KIND_COUNT];
+		for (int i = 0; i < views; i++)
+		{
+			SetView( *camera, s, i, views );
+			BenchView( *scene, *camera, sunDir, repeat, result );
+		}
+		printf( "%-16s", s.name.c_str() );
+		for (int k = 0; k < KIND_COUNT; k++) printf( " %6.2f/%-3.0f", result[k].MRays(), result[k].StepsPerRay() );
+		printf( "\n" );
+		for (int k = 0; k < KIND_COUNT; k++)
+			fprintf( f, ",\n      \"%s\": { \"rays\": %.0f, \"seconds\": %.6f, \"mrays_per_second\": %.3f, \"steps_per_ray\": %.3f }",
+				kindName[k], result[k].rays, result[k].seconds, result[k].MRays(), result[k].StepsPerRay() );
+		fprintf( f, " }" );
+	}
+	fprintf( f, "\n  ]\n}\n" );
+	fclose( f );
+	printf( "saved %s\n", json );
+	return 0;
+}
+
+#endif // BENCHMARK
@@ -46,6 +46,54 @@ Ray Camera::GetPrimaryRay( const float x, const float y )
 	// - there are far cooler camera models, e.g. try 'Panini projection'.
 }
 
+void Camera::GetPrimaryRays8( const float* x, const float* y, RayPacket8& packet )
+{
+	// same as GetPrimaryRay, for 8 screen positions at once; directions are normalized
+	const __m256 u = _mm256_mul_ps( _mm256_loadu_ps( x ), _mm256_set1_ps( 1.0f / SCRWIDTH ) );
+	const __m256 v = _mm256_mul_ps( _mm256_loadu_ps( y ), _mm256_set1_ps( 1.0f / SCRHEIGHT ) );
+	const float3 base = topLeft - camPos, right = topRight - topLeft, down = bottomLeft - topLeft;
+	const __m256 Dx = _mm256_add_ps( _mm256_set1_ps( base.x ), _mm256_add_ps( _mm256_mul_ps( u, _mm256_set1_ps( right.x ) ), _mm256_mul_ps( v, _mm256_set1_ps( down.x ) ) ) );
+	const __m256 Dy = _mm256_add_ps( _mm256_set1_ps( base.y ), _mm256_add_ps( _mm256_mul_ps( u, _mm256_set1_ps( right.y ) ), _mm256_mul_ps( v, _mm256_set1_ps( down.y ) ) ) );
+	const __m256 Dz = _mm256_add_ps( _mm256_set1_ps( base.z ), _mm256_add_ps( _mm256_mul_ps( u, _mm256_set1_ps( right.z ) ), _mm256_mul_ps( v, _mm256_set1_ps( down.z ) ) ) );
+	const __m256 rlen = _mm256_div_ps( _mm256_set1_ps( 1 ), _mm256_sqrt_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( Dx, Dx ), _mm256_mul_ps( Dy, Dy ) ), _mm256_mul_ps( Dz, Dz ) ) ) );
+	_mm256_store_ps( packet.Dx, _mm256_mul_ps( Dx, rlen ) );
+	_mm256_store_ps( packet.Dy, _mm256_mul_ps( Dy, rlen ) );
+	_mm256_store_ps( packet.Dz, _mm256_mul_ps( Dz, rlen ) );
+	_mm256_store_ps( packet.Ox, _mm256_set1_ps( camPos.x ) );
+	_mm256_store_ps( packet.Oy, _mm256_set1_ps( camPos.y ) );
+	_mm256_store_ps( packet.Oz, _mm256_set1_ps( camPos.z ) );
+	_mm256_store_ps( packet.t, _mm256_set1_ps( 1e34f ) );
+	_mm256_store_si256( (__m256i*)packet.voxel, _mm256_setzero_si256() );
+	_mm256_store_si256( (__m256i*)packet.axis, _mm256_setzero_si256() );
+}
+
+void Camera::LookAt( const float3& pos, const float3& target )
+{
+	// place the camera and rebuild the view frustum, as HandleInput does
+	camPos = pos, camTarget = target;
+	const float3 ahead = normalize( camTarget - camPos );
+	const float3 tmpUp( 0, 1, 0 );
+	const float3 up = normalize( cross( ahead, normalize( cross( tmpUp, ahead ) ) ) );
+	const float3 right = normalize( cross( up, ahead ) );
+	topLeft = camPos + 2.0f * ahead - aspect * right + up;
+	topRight = camPos + 2.0f * ahead + aspect * right + up;
+	bottomLeft = camPos + 2.0f * ahead - aspect * right - up;
+}
+
+mat4 Camera::GetViewMatrix() const
+{
+	// world position to (u * w, v * w, w): u and v are screen coordinates in 0..1, as in
+	// GetPrimaryRay, and w is the depth along the view axis, 1 on the virtual screen plane
+	const float3 right = topRight - topLeft, down = bottomLeft - topLeft, base = topLeft - camPos;
+	mat4 M; // the inverse: (u', v', w') to camPos + u' * right + v' * down + w' * base
+	M( 0, 0 ) = right.x, M( 0, 1 ) = down.x, M( 0, 2 ) = base.x, M( 0, 3 ) = camPos.x;
+	M( 1, 0 ) = right.y, M( 1, 1 ) = down.y, M( 1, 2 ) = base.y, M( 1, 3 ) = camPos.y;
+	M( 2, 0 ) = right.z, M( 2, 1 ) = down.z, M( 2, 2 ) = base.z, M( 2, 3 ) = camPos.z;
+	mat4 view = M.Inverted();
+	view( 3, 0 ) = view( 3, 1 ) = view( 3, 2 ) = 0, view( 3, 3 ) = 1; // exactly affine: no divide in TransformPoint
+	return view;
+}
+
 bool Camera::HandleInput( const float t )
 {
 	if (!WindowHasFocus()) return false;
@@ -64,7 +112,7 @@ bool Camera::HandleInput( const float t )
 	up = normalize( cross( ahead, right ) );
 	if (IsKeyDown( GLFW_KEY_A )) camPos -= speed * right, changed = true;
 	if (IsKeyDown( GLFW_KEY_D )) camPos += speed * right, changed = true;
-	if (GetAsyncKeyState( 'W' )) camPos += speed * ahead, changed = true;
+	if (IsKeyDown( GLFW_KEY_W )) camPos += speed * ahead, changed = true;
 	if (IsKeyDown( GLFW_KEY_S )) camPos -= speed * ahead, changed = true;
 	if (IsKeyDown( GLFW_KEY_SPACE )) camPos += speed * up, changed = true;
 	if (IsKeyDown( GLFW_KEY_LEFT_CONTROL )) camPos -= speed * up, changed = true;
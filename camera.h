@@ -14,7 +14,10 @@ public:
 	Camera();
 	~Camera();
 	Ray GetPrimaryRay( const float x, const float y );
+	void GetPrimaryRays8( const float* x, const float* y, RayPacket8& packet );
 	bool HandleInput( const float t );
+	void LookAt( const float3& pos, const float3& target );
+	mat4 GetViewMatrix() const;
 	bool CameraHasMoved();
 	float aspect = (float)SCRWIDTH / (float)SCRHEIGHT;
 	float3 camPos, camTarget;
@@ -0,0 +1,133 @@
+#include "template.h"
+
+void Denoiser::Apply( const float3* accumulator, const float scale, const float3* position, const float3* normal,
+	const float3* hitAlbedo, const float3& cameraPosition, const uint sampleCount, uint* pixels )
+{
+	Timer timer;
+	width = SCRWIDTH, height = SCRHEIGHT;
+	const int N = width * height;
+	for (int c = 0; c < 3; c++) color[c].resize( N ), filtered[c].resize( N ), albedo[c].resize( N );
+	depth.resize( N ), slope.resize( N ), orientation.resize( N ), luminance.resize( N ), weight.resize( N );
+
+	// prepare: color and guides in planes; the sky has its own orientation, and depth 0
+#pragma omp parallel for schedule(static)
+	for (int idx = 0; idx < N; idx++)
+	{
+		const float3 n = normal[idx];
+		const bool sky = n.x == 0 && n.y == 0 && n.z == 0;
+		const float3 a = sky ? float3( 1 ) : hitAlbedo[idx], c = accumulator[idx] * scale;
+		color[0][idx] = c.x, color[1][idx] = c.y, color[2][idx] = c.z;
+		albedo[0][idx] = a.x, albedo[1][idx] = a.y, albedo[2][idx] = a.z;
+		orientation[idx] = sky ? 6.0f : n.x != 0 ? (n.x > 0 ? 0.0f : 1.0f) : n.y != 0 ? (n.y > 0 ? 2.0f : 3.0f) : (n.z > 0 ? 4.0f : 5.0f);
+		depth[idx] = sky ? 0 : length( position[idx] - cameraPosition );
+	}
+	// depth change per pixel: the smaller one-sided difference to a neighbour on a face with the
+	// same orientation, horizontally plus vertically; one-sided, so that edges don't count
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; y++) for (int x = 0; x < width; x++)
+	{
+		const int idx = x + y * width;
+		float s[2];
+		for (int axis = 0; axis < 2; axis++)
+		{
+			const int stride = axis ? width : 1;
+			const bool hasPrev = axis ? y > 0 : x > 0, hasNext = axis ? y < height - 1 : x < width - 1;
+			float best = 0;
+			bool found = false;
+			for (int side = 0; side < 2; side++)
+			{
+				if (!(side ? hasNext : hasPrev)) continue;
+				const int other = side ? idx + stride : idx - stride;
+				if (orientation[other] != orientation[idx]) continue;
+				const float d = fabsf( depth[other] - depth[idx] );
+				best = found ? min( best, d ) : d, found = true;
+			}
+			s[axis] = best;
+		}
+		slope[idx] = s[0] + s[1];
+	}
+	stageMs[PREPARE] = 0.9f * stageMs[PREPARE] + 0.1f * timer.elapsed() * 1000.0f;
+
+	// filter: the brightness threshold shrinks with every pass, and as the samples add up
+	timer.reset();
+	const float colorSigma = colorPhi / sqrtf( (float)max( 1u, sampleCount ) );
+	for (int pass = 0; pass < passes; pass++)
+	{
+		Pass( 1 << pass, colorSigma / (float)(1 << pass) );
+		for (int c = 0; c < 3; c++) color[c].swap( filtered[c] );
+	}
+	stageMs[FILTER] = 0.9f * stageMs[FILTER] + 0.1f * timer.elapsed() * 1000.0f;
+
+	// output
+	timer.reset();
+#pragma omp parallel for schedule(static)
+	for (int idx = 0; idx < N; idx++) pixels[idx] = RGBF32_to_RGB8( float3( color[0][idx], color[1][idx], color[2][idx] ) );
+	stageMs[OUTPUT] = 0.9f * stageMs[OUTPUT] + 0.1f * timer.elapsed() * 1000.0f;
+}
+
+static constexpr float ALBEDO_SIGMA = 0.05f; // summed albedo difference that halves a tap's weight
+
+// accumulate one tap for 'count' consecutive pixels: the pixel arrays start at the first pixel,
+// the tap arrays ('q' suffix) at its tap. Plain loops over restrict pointers, to vectorize
+static void AddTap( const int count, const float k, const float distance, const float zPhi, const float invColorSigma,
+	float* __restrict R, float* __restrict G, float* __restrict B, float* __restrict W,
+	const float* __restrict O, const float* __restrict Z, const float* __restrict S, const float* __restrict L,
+	const float* __restrict Ar, const float* __restrict Ag, const float* __restrict Ab,
+	const float* __restrict rq, const float* __restrict gq, const float* __restrict bq,
+	const float* __restrict Oq, const float* __restrict Zq, const float* __restrict Lq,
+	const float* __restrict Arq, const float* __restrict Agq, const float* __restrict Abq )
+{
+	for (int i = 0; i < count; i++)
+	{
+		// the depth may change by the local slope per pixel, times depthPhi
+		const float rz = fabsf( Z[i] - Zq[i] ) / (zPhi * S[i] * distance + 1e-3f * Z[i] + 1e-6f);
+		const float rc = fabsf( L[i] - Lq[i] ) * invColorSigma / (L[i] + Lq[i] + 1e-4f);
+		const float ra = (fabsf( Ar[i] - Arq[i] ) + fabsf( Ag[i] - Agq[i] ) + fabsf( Ab[i] - Abq[i] )) * (1.0f / ALBEDO_SIGMA);
+		const float w = (O[i] == Oq[i] ? k : 0.0f) / ((1 + rz * rz) * (1 + rc * rc) * (1 + ra * ra));
+		W[i] += w, R[i] += w * rq[i], G[i] += w * gq[i], B[i] += w * bq[i];
+	}
+}
+
+// one a-trous pass from 'color' to 'filtered', with taps 'step' pixels apart
+void Denoiser::Pass( const int step, const float colorSigma )
+{
+	const int N = width * height;
+	const float* r = color[0].data(), * g = color[1].data(), * b = color[2].data();
+	float* R = filtered[0].data(), * G = filtered[1].data(), * B = filtered[2].data(), * W = weight.data(), * L = luminance.data();
+	const float* O = orientation.data(), * Z = depth.data(), * S = slope.data();
+	const float* Ar = albedo[0].data(), * Ag = albedo[1].data(), * Ab = albedo[2].data();
+#pragma omp parallel for schedule(static)
+	for (int idx = 0; idx < N; idx++) L[idx] = 0.2126f * r[idx] + 0.7152f * g[idx] + 0.0722f * b[idx];
+	const float h[3] = { 3.0f / 8, 1.0f / 4, 1.0f / 16 }; // B3 spline, from the center outwards
+	const float invColorSigma = 2.0f / colorSigma;
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; y++)
+	{
+		const int row = y * width;
+		for (int p = row; p < row + width; p++)
+		{
+			const float k = h[0] * h[0];
+			W[p] = k, R[p] = k * r[p], G[p] = k * g[p], B[p] = k * b[p];
+		}
+		for (int ty = -2; ty <= 2; ty++)
+		{
+			const int yq = y + ty * step;
+			if (yq < 0 || yq >= height) continue;
+			for (int tx = -2; tx <= 2; tx++)
+			{
+				if (tx == 0 && ty == 0) continue;
+				// taps that fall outside the screen are skipped
+				const int dx = tx * step, x0 = max( 0, -dx ), x1 = min( width, width - dx );
+				const int p = row + x0, q = yq * width + x0 + dx;
+				AddTap( x1 - x0, h[abs( tx )] * h[abs( ty )], (float)((abs( tx ) + abs( ty )) * step), depthPhi, invColorSigma,
+					R + p, G + p, B + p, W + p, O + p, Z + p, S + p, L + p, Ar + p, Ag + p, Ab + p,
+					r + q, g + q, b + q, O + q, Z + q, L + q, Ar + q, Ag + q, Ab + q );
+			}
+		}
+		for (int p = row; p < row + width; p++)
+		{
+			const float inv = 1.0f / W[p];
+			R[p] *= inv, G[p] *= inv, B[p] *= inv;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al., 2010) for the first few samples after
+// a reset (see maxSamples). A 5x5 B3-spline kernel is applied a few times with taps spread 1, 2,
+// 4, .. pixels apart, so a wide blur costs 25 taps per pass. Every tap is weighted by how alike the two
+// pixels are: the same voxel face orientation, a depth that fits the local depth slope, the
+// same albedo, so that material edges stay sharp, and similar brightness. All data lives in
+// planes of floats and the taps are added a row of pixels at a time, so the loops vectorize.
+
+namespace Tmpl8 {
+
+class Denoiser
+{
+public:
+	enum { PREPARE = 0, FILTER, OUTPUT, STAGES };
+	// filter 'accumulator' * 'scale', with the primary hits of the pixels as guides, into 'pixels'.
+	// 'position' and 'normal' are as in Renderer::gPosition and gNormal: a zero normal is the sky
+	void Apply( const float3* accumulator, const float scale, const float3* position, const float3* normal,
+		const float3* albedo, const float3& cameraPosition, const uint sampleCount, uint* pixels );
+	int passes = 4;					// taps up to 2^(passes - 1) * 2 pixels away
+	float colorPhi = 1.0f;			// larger: blur more over brightness differences
+	float depthPhi = 1.0f;			// larger: blur more over depth differences
+	int maxSamples = 8;				// above this many samples per pixel the image is shown as it is
+	float stageMs[STAGES] = {};		// smoothed time per stage
+private:
+	void Pass( const int step, const float colorSigma );
+	int width = 0, height = 0;
+	std::vector<float> color[3], filtered[3];	// in and out of a pass
+	std::vector<float> depth, slope, orientation, albedo[3], luminance, weight;
+};
+
+} // namespace Tmpl8
@@ -23,4 +23,13 @@ float3 Ray::GetAlbedo(const Scene& scene) const
 {
 	// return the (floating point) albedo at the nearest intersection
 	return scene.materials[voxel].albedo;
-}
\ No newline at end of file
+}
+
+Ray RayPacket8::GetRay( const int lane ) const
+{
+	Ray ray( float3( Ox[lane], Oy[lane], Oz[lane] ), float3( Dx[lane], Dy[lane], Dz[lane] ), t[lane], voxel[lane] );
+	ray.axis = axis[lane];
+	ray.steps = steps[lane];
+	if (voxel[lane]) ray.materialIndex = voxel[lane];
+	return ray;
+}
@@ -26,6 +26,8 @@ public:
 	uint axis = 0;				// axis of last plane passed by the ray
 	bool inside = false;		// if true, ray started in voxel and t is at exit point
 	int materialIndex = -1;
+	uint steps = 0;				// traversal steps taken for this ray (statistics)
+	float tstart = 0;			// FindNearest: nothing to hit before this distance (beam prepass)
 private:
 	// min3 is used in normal reconstruction.
 	__inline static float3 min3( const float3& a, const float3& b )
@@ -34,4 +36,18 @@ private:
 	}
 };
 
+// 8 rays in SoA layout, traced together in the lanes of AVX2 registers by Scene::FindNearest8.
+// Intended for coherent rays, e.g. a row of 8 camera rays.
+struct ALIGN( 32 ) RayPacket8
+{
+	Ray GetRay( const int lane ) const; // scalar ray for one lane, including its intersection
+	float Ox[8], Oy[8], Oz[8];	// ray origins
+	float Dx[8], Dy[8], Dz[8];	// normalized ray directions
+	float t[8];					// ray length; distance to the nearest hit after traversal
+	uint voxel[8];				// payload of the intersected voxel, 0 if the ray missed
+	uint axis[8];				// axis of last plane passed by the ray
+	uint steps[8];				// traversal steps taken per lane (statistics)
+	float tstart[8] = {};		// FindNearest8: nothing to hit before this distance (beam prepass)
+};
+
 };
\ No newline at end of file
@@ -1,11 +1,10 @@
 #include "template.h"
 #include "Core/ShadingPoint.h"
-#include "Core/Lighting/Light.h"
-#include "Core/Lighting/PointLight.h"
-#include "Core/Lighting/DirectionalLight.h"
-#include "Core/Lighting/SpotLight.h"
-#include "Core/Lighting/AreaLight.h"
 
+// rays traced by this thread (primary and secondary, not shadow rays); see Renderer::raysPerPixel
+static thread_local uint64_t tracedRays = 0;
+// pixel of the path that this thread is shading; seeds the per-pixel light sample sequences
+static thread_local uint shadePixel = 0;
 
 
 // -----------------------------------------------------------
@@ -13,13 +12,53 @@
 // -----------------------------------------------------------
 float3 Renderer::Trace(Ray& ray, int depth, int, int)
 {
-    const int MAX_DEPTH = 5;
     if (depth >= MAX_DEPTH) return float3(0, 0, 0);
 
     scene.FindNearest(ray);
+    tracedRays++;
+    return Shade(ray, depth);
+}
+
+// -----------------------------------------------------------
+// Same as Trace, for a ray that has already been intersected
+// with the scene; the legacy mode traces it again
+// -----------------------------------------------------------
+float3 Renderer::TraceHit(Ray& ray, int depth)
+{
+    if (!reuseHits) return Trace(ray, depth);
+    if (depth >= MAX_DEPTH) return float3(0, 0, 0);
+    return Shade(ray, depth);
+}
 
+// -----------------------------------------------------------
+// Light arriving at a Lambertian point, times its albedo; from the
+// radiance cache once the point's voxel face has converged
+// -----------------------------------------------------------
+float3 Renderer::DirectLight(const ShadingPoint& sp)
+{
+    float3 result(0);
+    if (useRadianceCache)
+    {
+        radianceCache.lookups.fetch_add(1, std::memory_order_relaxed);
+        if (radianceCache.Lookup(sp.position, sp.normal, result))
+        {
+            radianceCache.hits.fetch_add(1, std::memory_order_relaxed);
+            return result;
+        }
+    }
+    if (sampleLights) lights.Sample(sp, scene, float3(1), result, lightSamples);
+    else lights.Illuminate(sp, scene, float3(1), result);
+    if (useRadianceCache) radianceCache.Add(sp.position, sp.normal, result);
+    return result;
+}
+
+// -----------------------------------------------------------
+// Shade a ray that has already been intersected with the scene
+// -----------------------------------------------------------
+float3 Renderer::Shade(Ray& ray, int depth)
+{
     // Safety check for background or invalid material
-    if (ray.voxel == 0 || ray.materialIndex < 0 || ray.materialIndex >= MAT_COUNT)
+    if (ray.voxel == 0 || ray.materialIndex < 0 || ray.materialIndex >= (int)scene.materialCount)
         return float3(0.53f, 0.81f, 0.92f);
 
     const Material& mat = scene.materials[ray.materialIndex];
@@ -28,6 +67,7 @@ float3 Renderer::Trace(Ray& ray, int depth, int, int)
     sp.position = ray.IntersectionPoint();
     sp.normal = ray.GetNormal();
     sp.albedo = ray.GetAlbedo(scene);
+    sp.pixel = shadePixel;
 
     if (debugNormals)
         return 0.5f * (sp.normal + float3(1.0f));
@@ -35,13 +75,7 @@ float3 Renderer::Trace(Ray& ray, int depth, int, int)
     switch (mat.type)
     {
     case MaterialType::Lambertian:
-    {
-        float3 result(0);
-        for (Light* light : lights)
-            if (light->enabled)
-                result += light->Illuminate(sp, scene);
-        return result * mat.albedo;
-    }
+        return DirectLight(sp) * mat.albedo;
 
     case MaterialType::Metal:
     {
@@ -53,12 +87,13 @@ float3 Renderer::Trace(Ray& ray, int depth, int, int)
 
         Ray aRay(sp.position + N * EPSILON, R);
         scene.FindNearest(aRay);
+        tracedRays++;
 
         // Safety check
-        if (aRay.voxel == 0 || aRay.materialIndex < 0 || aRay.materialIndex >= MAT_COUNT)
+        if (aRay.voxel == 0 || aRay.materialIndex < 0 || aRay.materialIndex >= (int)scene.materialCount)
             return float3(0.53f, 0.81f, 0.92f);
 
-        return Trace(aRay, depth + 1) * scene.materials[aRay.materialIndex].albedo;
+        return TraceHit(aRay, depth + 1) * scene.materials[aRay.materialIndex].albedo;
     }
 
     case MaterialType::Dielectric:
@@ -76,17 +111,19 @@ float3 Renderer::Trace(Ray& ray, int depth, int, int)
         {
             Ray reflectedRay(sp.position + N * EPSILON, reflect(I, N));
             scene.FindNearest(reflectedRay);
-            if (reflectedRay.voxel == 0 || reflectedRay.materialIndex < 0 || reflectedRay.materialIndex >= MAT_COUNT)
+            tracedRays++;
+            if (reflectedRay.voxel == 0 || reflectedRay.materialIndex < 0 || reflectedRay.materialIndex >= (int)scene.materialCount)
                 return float3(0.53f, 0.81f, 0.92f);
-            return Trace(reflectedRay, depth + 1);
+            return TraceHit(reflectedRay, depth + 1);
         }
         else
         {
             Ray refractedRay(sp.position - N * EPSILON, refracted);
             scene.FindNearest(refractedRay);
-            if (refractedRay.voxel == 0 || refractedRay.materialIndex < 0 || refractedRay.materialIndex >= MAT_COUNT)
+            tracedRays++;
+            if (refractedRay.voxel == 0 || refractedRay.materialIndex < 0 || refractedRay.materialIndex >= (int)scene.materialCount)
                 return float3(0.53f, 0.81f, 0.92f);
-            return Trace(refractedRay, depth + 1);
+            return TraceHit(refractedRay, depth + 1);
         }
     }
 
@@ -115,14 +152,13 @@ return albedo * max( 0.3f, dot( N, L ) );
 void Renderer::Init()
 {
 	// Create lights
-	pointLight = new PointLight({ 1,1,1 }, { 1,1,1 });
-	pointLight->enabled = false;
+	const int pointLight = lights.AddPoint({ 1,1,1 }, { 1,1,1 });
+	lights.point.enabled[pointLight] = false;
 
-	dirLight = new DirectionalLight({ 0.3f, -0.35f,0.9f }, { 1,1,1 });
-    dirLight->enabled = true;
+	lights.AddDirectional({ 0.3f, -0.35f,0.9f }, { 1,1,1 });
 
-	spotLight = new SpotLight({ 1.5f,1.5f,1.4f }, { -0.57f,-0.58f,-0.5f }, { 1,1,0.8f }, 10.f);
-	spotLight->enabled = false;
+	const int spotLight = lights.AddSpot({ 1.5f,1.5f,1.4f }, { -0.57f,-0.58f,-0.5f }, { 1,1,0.8f }, 10.f);
+	lights.spot.enabled[spotLight] = false;
 
     float3 center = float3(0, 5, 0);
 
@@ -131,7 +167,7 @@ void Renderer::Init()
 
     float3 corner = center - edge1 * 0.5f - edge2 * 0.5f;
 
-    areaLight = new AreaLight(
+    const int areaLight = lights.AddArea(
         corner,
         edge1,
         edge2,
@@ -139,9 +175,7 @@ void Renderer::Init()
         16, 16                         // 16 samples total
     );
 
-    areaLight->enabled = false;
-
-	lights = { pointLight, dirLight, spotLight, areaLight };
+    lights.area.enabled[areaLight] = false;
 
     //accumulator
     accumulator = new float3[SCRWIDTH * SCRHEIGHT];
@@ -149,6 +183,119 @@ void Renderer::Init()
 
 }
 
+// -----------------------------------------------------------
+// Keep the primary hit of a pixel, for reprojection and the denoiser
+// -----------------------------------------------------------
+void Renderer::RecordHit(const int idx, const float3& O, const float3& D, const float t, const uint voxel, const uint axis)
+{
+    gPosition[idx] = O + t * D;
+    if (voxel == 0 || voxel >= scene.materialCount)
+    {
+        gNormal[idx] = float3(0), gAlbedo[idx] = float3(1);
+        return;
+    }
+    // voxel normal, as in Ray::GetNormal
+    float3 N(0);
+    N[axis] = std::signbit(D[axis]) ? 1.0f : -1.0f;
+    gNormal[idx] = N, gAlbedo[idx] = scene.materials[voxel].albedo;
+}
+
+// -----------------------------------------------------------
+// Beam prepass: the camera rays of a tile lie in the cone around
+// the center of the tile through its corners. Whatever the cone
+// holds no voxels in, its rays can skip, minus the nudge that
+// FindNearest gives the origin and some slack for rounding.
+// Rebuilt when the camera moved or the voxels changed
+// -----------------------------------------------------------
+void Renderer::BeamPrepass(const bool moved)
+{
+    if (!useBeamPrepass) { beamStart.clear(); return; }
+    if (!moved && !beamStart.empty() && beamSceneVersion == scene.version) return;
+    Timer timer;
+    beamTilesX = (SCRWIDTH + BEAM_TILE - 1) / BEAM_TILE;
+    const int tilesY = (SCRHEIGHT + BEAM_TILE - 1) / BEAM_TILE;
+    beamStart.resize(beamTilesX * tilesY);
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < beamTilesX * tilesY; tile++)
+    {
+        const float x0 = (float)((tile % beamTilesX) * BEAM_TILE), y0 = (float)((tile / beamTilesX) * BEAM_TILE);
+        const float x1 = min(x0 + BEAM_TILE, (float)SCRWIDTH), y1 = min(y0 + BEAM_TILE, (float)SCRHEIGHT);
+        const float3 corner[4] = { camera.GetPrimaryRay(x0, y0).D, camera.GetPrimaryRay(x1, y0).D,
+            camera.GetPrimaryRay(x0, y1).D, camera.GetPrimaryRay(x1, y1).D };
+        const float3 axis = normalize(corner[0] + corner[1] + corner[2] + corner[3]);
+        float cosAngle = 1;
+        for (int i = 0; i < 4; i++) cosAngle = min(cosAngle, dot(axis, corner[i]));
+        const float slope = sqrtf(max(0.0f, 1 - cosAngle * cosAngle)) / cosAngle;
+        const float T = scene.ConeFreeDistance(camera.camPos, axis, slope);
+        beamStart[tile] = max(0.0f, T - EPSILON - 0.01f / WORLDSIZE);
+    }
+    beamSceneVersion = scene.version, beamMs = timer.elapsed() * 1000.0f;
+}
+
+// -----------------------------------------------------------
+// Render pixels x0..x1-1 of row y with the recursive Trace;
+// returns the traversal steps of the primary rays
+// -----------------------------------------------------------
+uint64_t Renderer::RenderSpan(const int x0, const int x1, const int y, const bool packets, const float invSampleCount)
+{
+    uint64_t primarySteps = 0;
+    int x = x0;
+    if (packets)
+    {
+        // primary rays in packets of 8 neighbouring pixels, shaded one by one
+        for (; x + 8 <= x1; x += 8)
+        {
+            // spans start at a multiple of 8, so the 8 pixels share an adaptive tile
+            if (!PixelActive(x, y)) continue;
+            float px[8], py[8];
+            for (int i = 0; i < 8; i++) px[i] = x + i + RandomFloat(), py[i] = y + RandomFloat();
+            RayPacket8 packet;
+            camera.GetPrimaryRays8(px, py, packet);
+            for (int i = 0; i < 8; i++) packet.tstart[i] = BeamStart(x, y); // spans start at a multiple of 8 too
+            scene.FindNearest8(packet);
+            tracedRays += 8;
+            for (int i = 0; i < 8; i++)
+            {
+                const int idx = x + i + y * SCRWIDTH;
+                Ray r = packet.GetRay(i);
+                if (recordHits) RecordHit(idx, r.O, r.D, r.t, r.voxel, r.axis);
+                shadePixel = idx;
+                AddSample(idx, Shade(r, 0));
+                primarySteps += r.steps;
+                screen->pixels[idx] = RGBF32_to_RGB8(accumulator[idx] * invSampleCount);
+            }
+        }
+    }
+    for (; x < x1; x++)
+    {
+        if (!PixelActive(x, y)) continue;
+        const int idx = x + y * SCRWIDTH;
+        InitSeed(idx);
+        // Optional subpixel jitter (recommended)
+        float px = x + RandomFloat();
+        float py = y + RandomFloat();
+
+        Ray r = camera.GetPrimaryRay(px, py);
+        r.tstart = BeamStart(x, y);
+
+        // One sample
+        shadePixel = idx;
+        float3 sample = Trace(r, 0, 0, 0);
+        primarySteps += r.steps;
+        if (recordHits) RecordHit(idx, r.O, r.D, r.t, r.voxel, r.axis); // Shade leaves the primary hit in r
+
+        // Accumulate
+        AddSample(idx, sample);
+
+        // Average
+        float3 avg = accumulator[idx] * invSampleCount;
+
+        // Display
+        screen->pixels[idx] = RGBF32_to_RGB8(avg);
+    }
+    return primarySteps;
+}
+
 // -----------------------------------------------------------
 // Main application tick function - Executed every frame
 // -----------------------------------------------------------
@@ -157,42 +304,92 @@ void Renderer::Tick(float deltaTime)
 
     if (editingMaterial) return; // skip tracing while editing
 
-    // Reset accumulation if camera moved
-    if (camera.HandleInput(deltaTime))
+    // camera moved: reproject the accumulated image into the new view, or start over
+    bool reprojecting = false;
+    bool moved = camera.HandleInput(deltaTime);
+    moved = camera.CameraHasMoved() || moved;
+    if (moved)
     {
-        ResetAccumulator();
+        if (useReprojection) reprojecting = KeepHistory();
+        else ResetAccumulator();
     }
+    recordHits = useReprojection || useDenoiser;
+    if (recordHits) gPosition.resize(SCRWIDTH * SCRHEIGHT), gNormal.resize(SCRWIDTH * SCRHEIGHT), gAlbedo.resize(SCRWIDTH * SCRHEIGHT);
+
+    // bring the active traversal backend up to date with the voxel data, and the light
+    // distribution with the lights (they can change in the UI)
+    scene.Commit();
+    lights.UpdateDistribution();
+    lights.UpdateShadowCaches(scene);
+    BeamPrepass(moved);
+    if (useRadianceCache)
+    {
+        // cached light goes stale when the lights, materials or voxels change
+        const uint64_t signature = RadianceCache::Signature(lights, scene);
+        if (signature != radianceCache.signature) radianceCache.Clear(), radianceCache.signature = signature;
+        radianceCache.lookups = radianceCache.hits = 0;
+    }
+    Timer traceTimer;
 
-    // New sample this frame
+    // New sample this frame; with adaptive sampling, one pass per sample over the active pixels
     sampleCount++;
     const float invSampleCount = 1.0f / sampleCount;
+    PlanSamples();
 
-#pragma omp parallel for schedule(dynamic)
-    for (int y = 0; y < SCRHEIGHT; y++)
+    Timer passTimer;
+    uint64_t primarySteps = 0, rays = 0;
+    const bool packets = usePackets && CPUCaps::HW_AVX2;
+    for (int pass = 0; pass < samplesPerPixel; pass++)
     {
-        for (int x = 0; x < SCRWIDTH; x++)
+        lights.frame = frameIndex++;
+        if (useWavefront)
         {
-            const int idx = x + y * SCRWIDTH;
-            InitSeed(idx);
-            // Optional subpixel jitter (recommended)
-            float px = x + RandomFloat();
-            float py = y + RandomFloat();
-
-            Ray r = camera.GetPrimaryRay(px, py);
-
-            // One sample
-            float3 sample = Trace(r, 0, 0, 0);
-
-            // Accumulate
-            accumulator[idx] += sample;
-
-            // Average
-            float3 avg = accumulator[idx] * invSampleCount;
-
-            // Display
-            screen->pixels[idx] = RGBF32_to_RGB8(avg);
+            uint64_t passRays = 0;
+            primarySteps += RenderWavefront(packets, passRays);
+            rays += passRays;
+        }
+        else if (useTiles)
+        {
+            // square tiles in Morton order, distributed over the threads with work stealing
+            if (tileScheduler.tileSize != tileSize) tileScheduler.Init(SCRWIDTH, SCRHEIGHT, tileSize);
+            std::atomic<uint64_t> tileSteps(0), tileRays(0);
+            tileScheduler.Run([&](const int x0, const int y0)
+            {
+                const uint64_t raysBefore = tracedRays;
+                uint64_t steps = 0;
+                for (int y = y0; y < min(y0 + tileSize, SCRHEIGHT); y++)
+                    steps += RenderSpan(x0, min(x0 + tileSize, SCRWIDTH), y, packets, invSampleCount);
+                tileSteps += steps, tileRays += tracedRays - raysBefore;
+            });
+            primarySteps += tileSteps, rays += tileRays;
+        }
+        else
+        {
+#pragma omp parallel for schedule(dynamic) reduction(+:primarySteps, rays)
+            for (int y = 0; y < SCRHEIGHT; y++)
+            {
+                const uint64_t raysBefore = tracedRays;
+                primarySteps += RenderSpan(0, SCRWIDTH, y, packets, invSampleCount);
+                rays += tracedRays - raysBefore;
+            }
         }
     }
+    UpdateConvergence(passTimer.elapsed() * 1000.0f);
+
+    if (reprojecting) Reproject();
+    gBufferValid = useReprojection, lastViewMatrix = camera.GetViewMatrix();
+    if (useDenoiser && sampleCount <= (uint)denoiser.maxSamples)
+        denoiser.Apply(accumulator, 1.0f / sampleCount, gPosition.data(), gNormal.data(), gAlbedo.data(), camera.camPos, sampleCount, screen->pixels);
+
+    // performance stats; for now only primary rays are counted
+    const float traceMs = traceTimer.elapsed() * 1000.0f;
+    avgFrameTimeMs = 0.9f * avgFrameTimeMs + 0.1f * traceMs;
+    fps = 1000.0f / avgFrameTimeMs;
+    const float primaryRays = activeFraction * samplesPerPixel * (SCRWIDTH * SCRHEIGHT);
+    rps = primaryRays / (avgFrameTimeMs * 1000.0f);
+    if (primaryRays > 0) (packets ? packetStepsPerRay : stepsPerRay[scene.backend]) = (float)primarySteps / primaryRays;
+    raysPerPixel = (float)rays / (SCRWIDTH * SCRHEIGHT);
+    radianceHitRate = radianceCache.lookups ? (float)radianceCache.hits / radianceCache.lookups : 0.f;
 }
 
 // -----------------------------------------------------------
@@ -206,6 +403,76 @@ void Renderer::UI()
 
     ImGui::Text("voxel: %i", r.voxel);
     ImGui::Text("%5.2f ms (%.1f FPS) - %.1f Mrays/s", avgFrameTimeMs, fps, rps);
+    ImGui::Text("scene: %u bricks, %.1f MB%s", scene.brickCount - (uint)scene.freeBricks.size(), scene.MemoryUsage() / (1024.0f * 1024.0f), scene.mapping ? " (mapped)" : "");
+    ImGui::SameLine();
+    if (ImGui::Button("Save world")) scene.Save("scene.vxw");
+    static const char* backendLabels[] = { "Brick map", "64-tree", "Brick map + occupancy pyramid" };
+    if (ImGui::Combo("Backend", &scene.backend, backendLabels, IM_ARRAYSIZE(backendLabels)))
+        scene.Commit(), ResetAccumulator();
+    if (scene.backend == Scene::TREE64)
+        ImGui::Text("64-tree: %zu nodes, %.1f MB", scene.tree.nodes.size(), scene.tree.MemoryUsage() / (1024.0f * 1024.0f));
+    if (scene.backend == Scene::BRICKMAP) ImGui::Checkbox("Brick walk specialized on the ray octant", &scene.octantKernels);
+    if (CPUCaps::HW_AVX2) ImGui::Checkbox("8-wide packets for primary rays", &usePackets);
+    ImGui::Checkbox("Wavefront pipeline", &useWavefront);
+    if (!useWavefront)
+    {
+        ImGui::Checkbox("Shade bounce hits without tracing them again", &reuseHits);
+        ImGui::Checkbox("Tile scheduler with work stealing", &useTiles);
+        if (useTiles)
+        {
+            ImGui::SameLine();
+            ImGui::RadioButton("8x8", &tileSize, 8), ImGui::SameLine(), ImGui::RadioButton("16x16", &tileSize, 16);
+            float busy = 0, idle = 0, maxBusy = 0;
+            uint steals = 0;
+            for (const TileScheduler::ThreadStats& t : tileScheduler.stats)
+                busy += t.busyMs, idle += t.idleMs, maxBusy = max(maxBusy, t.busyMs), steals += t.steals;
+            const float threads = (float)max(1, (int)tileScheduler.stats.size());
+            ImGui::Text("%i threads: busy %.2f ms avg / %.2f ms max, idle %.2f ms avg, %u steals",
+                (int)threads, busy / threads, maxBusy, idle / threads, steals);
+            if (ImGui::CollapsingHeader("Per-thread timings"))
+                for (size_t i = 0; i < tileScheduler.stats.size(); i++)
+                {
+                    const TileScheduler::ThreadStats& t = tileScheduler.stats[i];
+                    ImGui::Text("thread %2zu: busy %6.2f ms, idle %6.2f ms, %4u tiles, %u steals", i, t.busyMs, t.idleMs, t.tiles, t.steals);
+                }
+        }
+    }
+    ImGui::Text("rays per pixel: %.2f (excluding shadow rays)", raysPerPixel);
+    if (useWavefront)
+    {
+        ImGui::Text("generate %.2f ms, extend %.2f ms, shade %.2f ms, connect %.2f ms",
+            stageMs[WF_GENERATE], stageMs[WF_EXTEND], stageMs[WF_SHADE], stageMs[WF_CONNECT]);
+        ImGui::Checkbox("Batch and sort shadow rays", &batchShadows);
+        if (batchShadows) ImGui::SameLine(), ImGui::Text("%.2f shadow rays per pixel", shadowRaysPerPixel);
+    }
+    ImGui::Text("steps per primary ray: brick map %.1f, 64-tree %.1f, pyramid %.1f, packets %.1f",
+        stepsPerRay[Scene::BRICKMAP], stepsPerRay[Scene::TREE64], stepsPerRay[Scene::PYRAMID], packetStepsPerRay);
+    ImGui::Checkbox("Beam prepass: primary rays skip the empty space of their tile", &useBeamPrepass);
+    if (useBeamPrepass) ImGui::SameLine(), ImGui::Text("%.2f ms", beamMs);
+    ImGui::Checkbox("Reproject the image when the camera moves", &useReprojection);
+    if (useReprojection)
+    {
+        ImGui::SliderInt("Max history (frames)", &maxHistory, 1, 64);
+        ImGui::Text("%.1f%% of the history kept in the last move", 100.0f * reprojectedFraction);
+    }
+    ImGui::Checkbox("Denoise (a-trous)", &useDenoiser);
+    if (useDenoiser)
+    {
+        ImGui::SliderInt("Denoiser passes", &denoiser.passes, 1, 5);
+        ImGui::SliderFloat("Color threshold", &denoiser.colorPhi, 0.1f, 8.0f);
+        ImGui::SliderFloat("Depth threshold", &denoiser.depthPhi, 0.1f, 8.0f);
+        ImGui::SliderInt("Denoise up to (spp)", &denoiser.maxSamples, 1, 64);
+        ImGui::Text("prepare %.2f ms, filter %.2f ms, output %.2f ms",
+            denoiser.stageMs[Denoiser::PREPARE], denoiser.stageMs[Denoiser::FILTER], denoiser.stageMs[Denoiser::OUTPUT]);
+    }
+    ImGui::Checkbox("Adaptive sampling", &adaptiveSampling);
+    if (adaptiveSampling)
+    {
+        ImGui::SliderFloat("Relative error", &adaptiveThreshold, 0.002f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderInt("Min samples per tile", &adaptiveMinSamples, 2, 256);
+        ImGui::SliderInt("Max samples per frame", &maxSamplesPerPixel, 1, 32);
+    }
+    ImGui::Text("%.1f%% of the pixels active, %i samples each", 100.0f * activeFraction, samplesPerPixel);
     ImGui::Separator();
     ImGui::Checkbox("Show Normals", &debugNormals);
 
@@ -229,59 +496,100 @@ void Renderer::UI()
 
 
 
-void Renderer::LightUI() const
+void Renderer::LightUI()
 {
 
     ImGui::Text("Lights");
+    if (ImGui::Checkbox("Sample lights by power", &sampleLights)) ResetAccumulator();
+    if (sampleLights)
+    {
+        if (ImGui::SliderInt("Lights per shading point", &lightSamples, 1, 8)) ResetAccumulator();
+        ImGui::Text("%i enabled lights", lights.EnabledCount());
+    }
+    if (ImGui::SliderInt("Area light samples per frame (0: full grid)", &lights.areaSamples, 0, 4)) ResetAccumulator();
+    if (ImGui::Checkbox("Cache directional light visibility per voxel face", &lights.useShadowCache)) ResetAccumulator();
+    if (ImGui::Checkbox("Cache direct light per voxel face", &useRadianceCache)) ResetAccumulator();
+    if (useRadianceCache)
+    {
+        ImGui::SliderInt("Samples per face", (int*)&radianceCache.samplesToConverge, 1, 1024);
+        ImGui::Text("radiance cache: %.1f%% hits, %.1f MB", 100.0f * radianceHitRate, radianceCache.MemoryUsage() / (1024.0f * 1024.0f));
+    }
 
+    // one section per light, grouped by type
+    auto enabledBox = [](uchar& enabled)
+        {
+            bool on = enabled != 0;
+            if (ImGui::Checkbox("Enabled", &on)) enabled = on;
+        };
     int lightIndex = 0;
-    for (Light* light : lights)
+    for (int i = 0; i < lights.point.Count(); i++)
     {
         ImGui::PushID(lightIndex++);
-        ImGui::Checkbox("Enabled", &light->enabled);
-
-        if (PointLight* pl = dynamic_cast<PointLight*>(light))
+        enabledBox(lights.point.enabled[i]);
+        if (ImGui::CollapsingHeader("Point Light###Header", ImGuiTreeNodeFlags_DefaultOpen))
         {
-            if (ImGui::CollapsingHeader("Point Light###Header", ImGuiTreeNodeFlags_DefaultOpen))
-            {
-                ImGui::DragFloat3("Position", &pl->position.x, 0.1f);
-                ImGui::ColorEdit3("Color", &pl->color.x);
-            }
+            float3 position(lights.point.x[i], lights.point.y[i], lights.point.z[i]);
+            if (ImGui::DragFloat3("Position", &position.x, 0.1f))
+                lights.point.x[i] = position.x, lights.point.y[i] = position.y, lights.point.z[i] = position.z;
+            ImGui::ColorEdit3("Color", &lights.point.color[i].x);
         }
-        else if (DirectionalLight* dl = dynamic_cast<DirectionalLight*>(light))
+        ImGui::PopID();
+    }
+    for (int i = 0; i < lights.directional.Count(); i++)
+    {
+        ImGui::PushID(lightIndex++);
+        enabledBox(lights.directional.enabled[i]);
+        if (ImGui::CollapsingHeader("Directional Light##Header", ImGuiTreeNodeFlags_DefaultOpen))
         {
-            if (ImGui::CollapsingHeader("Directional Light##Header", ImGuiTreeNodeFlags_DefaultOpen))
+            float3 direction(lights.directional.dx[i], lights.directional.dy[i], lights.directional.dz[i]);
+            if (ImGui::DragFloat3("Direction", &direction.x, 0.01f))
             {
-                ImGui::DragFloat3("Direction", &dl->direction.x, 0.01f);
-                dl->direction = normalize(dl->direction);
-                ImGui::ColorEdit3("Color", &dl->color.x);
+                direction = normalize(direction);
+                lights.directional.dx[i] = direction.x, lights.directional.dy[i] = direction.y, lights.directional.dz[i] = direction.z;
             }
+            ImGui::ColorEdit3("Color", &lights.directional.color[i].x);
+            const ShadowCache& cache = lights.directional.cache[i];
+            if (lights.useShadowCache) ImGui::Text("shadow cache: %.1f MB, built in %.1f ms", cache.MemoryUsage() / (1024.0f * 1024.0f), cache.buildMs);
         }
-        else if (SpotLight* sl = dynamic_cast<SpotLight*>(light))
+        ImGui::PopID();
+    }
+    for (int i = 0; i < lights.spot.Count(); i++)
+    {
+        ImGui::PushID(lightIndex++);
+        enabledBox(lights.spot.enabled[i]);
+        if (ImGui::CollapsingHeader("Spot Light##Header", ImGuiTreeNodeFlags_DefaultOpen))
         {
-            if (ImGui::CollapsingHeader("Spot Light##Header", ImGuiTreeNodeFlags_DefaultOpen))
+            float3 position(lights.spot.x[i], lights.spot.y[i], lights.spot.z[i]);
+            if (ImGui::DragFloat3("Position", &position.x, 0.1f))
+                lights.spot.x[i] = position.x, lights.spot.y[i] = position.y, lights.spot.z[i] = position.z;
+            float3 direction(lights.spot.dx[i], lights.spot.dy[i], lights.spot.dz[i]);
+            if (ImGui::DragFloat3("Direction", &direction.x, 0.01f))
             {
-                ImGui::DragFloat3("Position", &sl->position.x, 0.1f);
-                ImGui::DragFloat3("Direction", &sl->direction.x, 0.01f);
-                sl->direction = normalize(sl->direction);
-                ImGui::ColorEdit3("Color", &sl->color.x);
-                ImGui::DragFloat("Range", &sl->range, 0.1f, 0.1f, 100.0f);
-                ImGui::DragFloat("Angle", &sl->spotAngleDeg, 0.1f, 0.1f, 90.0f);
-                ImGui::DragFloat("Edge Roughness", &sl->edgeRoughness, 0.01f, 0.0f, 1.0f);
-                sl->edgeRoughness = clamp(sl->edgeRoughness, 0.0f, 0.99f);
+                direction = normalize(direction);
+                lights.spot.dx[i] = direction.x, lights.spot.dy[i] = direction.y, lights.spot.dz[i] = direction.z;
             }
+            ImGui::ColorEdit3("Color", &lights.spot.color[i].x);
+            ImGui::DragFloat("Range", &lights.spot.range[i], 0.1f, 0.1f, 100.0f);
+            bool cone = ImGui::DragFloat("Angle", &lights.spot.angleDeg[i], 0.1f, 0.1f, 90.0f);
+            cone |= ImGui::DragFloat("Edge Roughness", &lights.spot.edgeRoughness[i], 0.01f, 0.0f, 1.0f);
+            lights.spot.edgeRoughness[i] = clamp(lights.spot.edgeRoughness[i], 0.0f, 0.99f);
+            if (cone) lights.UpdateSpot(i);
         }
-        else if (AreaLight* al = dynamic_cast<AreaLight*>(light))
+        ImGui::PopID();
+    }
+    for (int i = 0; i < lights.area.Count(); i++)
+    {
+        ImGui::PushID(lightIndex++);
+        enabledBox(lights.area.enabled[i]);
+        if (ImGui::CollapsingHeader("Area Light##Header", ImGuiTreeNodeFlags_DefaultOpen))
         {
-            if (ImGui::CollapsingHeader("Area Light##Header", ImGuiTreeNodeFlags_DefaultOpen))
-            {
-                ImGui::ColorEdit3("Color", &al->color.x);   // stays 01
-                ImGui::DragFloat("Intensity", &al->intensity, 0.1f, 0.0f, 1000.0f);
-                ImGui::Spacing();
-                ImGui::DragFloat3("Corner", &al->corner.x, 0.1f);
-                ImGui::DragFloat3("Edge 1", &al->edge1.x, 0.1f);
-                ImGui::DragFloat3("Edge 2", &al->edge2.x, 0.1f);
-            }
+            ImGui::ColorEdit3("Color", &lights.area.color[i].x);   // stays 0..1
+            ImGui::DragFloat("Intensity", &lights.area.intensity[i], 0.1f, 0.0f, 1000.0f);
+            ImGui::Spacing();
+            bool shape = ImGui::DragFloat3("Corner", &lights.area.corner[i].x, 0.1f);
+            shape |= ImGui::DragFloat3("Edge 1", &lights.area.edge1[i].x, 0.1f);
+            shape |= ImGui::DragFloat3("Edge 2", &lights.area.edge2[i].x, 0.1f);
+            if (shape) lights.area.normal[i] = normalize(cross(lights.area.edge1[i], lights.area.edge2[i]));
         }
         ImGui::PopID();
     }
@@ -343,6 +651,8 @@ void Tmpl8::Renderer::ResetAccumulator()
 {
     memset(accumulator, 0, SCRWIDTH * SCRHEIGHT * sizeof(float3));
     sampleCount = 0;
+    frameIndex = 0;
+    ResetConvergence();
 }
 
 void Renderer::MouseDown(int button)
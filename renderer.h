@@ -1,10 +1,5 @@
 #pragma once
 
-class Light;
-class PointLight;
-class DirectionalLight;
-class SpotLight;
-class AreaLight;
 class material;
 
 namespace Tmpl8
@@ -44,18 +39,76 @@ public:
 		r0 = r0 * r0;
 		return r0 + (1 - r0) * powf(1 - cosine, 5);
 	}
+	static constexpr int MAX_DEPTH = 5; // maximum path length
 	float avgFrameTimeMs = 16.67f; // smoothed frame time
 	float fps = 60.f;
 	float rps = 0.f; // million rays per second
+	float stepsPerRay[Scene::BACKEND_COUNT] = {}; // last measured traversal steps per primary ray, per backend
+	float packetStepsPerRay = 0.f; // same, for the 8-wide packet traversal
+	bool usePackets = true; // trace primary rays in packets of 8 when the CPU supports AVX2
+	bool useWavefront = true; // wavefront pipeline instead of the recursive Trace
+	bool reuseHits = true; // Trace: shade intersected bounce rays directly instead of tracing them again
+	float raysPerPixel = 0.f; // primary and bounce rays traced per pixel in the last frame
+	bool useTiles = true; // Trace: tile scheduler with work stealing instead of OpenMP over rows
+	int tileSize = 16; // tile scheduler: tile width and height in pixels
+	bool sampleLights = true; // pick lightSamples lights per shading point by power, instead of evaluating all
+	int lightSamples = 1;
+	enum { WF_GENERATE = 0, WF_EXTEND, WF_SHADE, WF_CONNECT, WF_STAGES };
+	float stageMs[WF_STAGES] = {}; // smoothed time per wavefront stage
+	bool batchShadows = true; // wavefront: trace shadow rays in sorted batches, in packets of 8 with AVX2
+	static constexpr int SHADOW_BATCH = 256; // shading points per shadow ray batch
+	float shadowRaysPerPixel = 0.f; // batched shadow rays in the last frame
+	bool useRadianceCache = false; // Lambertian: reuse the converged direct light of voxel faces
+	float radianceHitRate = 0.f; // fraction of Lambertian points served by the cache in the last frame
+	bool useReprojection = true; // camera motion: reproject the accumulated image instead of starting over
+	int maxHistory = 16; // reprojection: most frames of history a pixel carries into the new view
+	float reprojectedFraction = 0.f; // share of the history that survived the last camera motion
+	bool useDenoiser = false; // a-trous filter on the displayed image; the accumulator stays as it is
+	bool recordHits = false; // this frame records the primary hits: reprojection or denoiser on
+	bool useBeamPrepass = true; // primary rays skip the empty space in front of their tile, found by tracing a cone per tile
+	static constexpr int BEAM_TILE = 8; // beam prepass: tile width and height in pixels
+	float beamMs = 0.f; // beam prepass: time of the last build
+	bool adaptiveSampling = false; // skip converged tiles, and give their samples to the noisy ones
+	float adaptiveThreshold = 0.02f; // adaptive: standard error of a pixel, relative to its brightness, at which it has converged
+	int adaptiveMinSamples = 16; // adaptive: samples a tile takes before it may converge
+	int maxSamplesPerPixel = 8; // adaptive: most samples an active pixel takes in one frame
+	static constexpr int ADAPTIVE_TILE = 8; // adaptive: tile width and height in pixels
+	float activeFraction = 1.f; // share of the pixels traced in the last frame
+	int samplesPerPixel = 1; // samples every active pixel takes this frame
 
 
 
 	// game flow methods
 	void Init();
 	float3 Trace( Ray& ray, int = 0, int = 0, int = 0 );
+	float3 TraceHit( Ray& ray, int depth );
+	float3 Shade( Ray& ray, int depth );
+	float3 DirectLight( const ShadingPoint& sp );
+	uint64_t RenderSpan( const int x0, const int x1, const int y, const bool packets, const float invSampleCount );
+	uint64_t RenderWavefront( const bool packets, uint64_t& rays );
+	uint64_t Extend( RayQueue& queue, const bool packets );
+	uint64_t ConnectBatch( const int first, const int last, const bool packets );
+	void RecordHit( const int idx, const float3& O, const float3& D, const float t, const uint voxel, const uint axis );
+	bool KeepHistory();
+	void ResetConvergence();
+	void PlanSamples();
+	void UpdateConvergence( const float ms );
+	void BeamPrepass( const bool moved );
+	// distance a primary ray of pixel x, y can skip; 0 when the beam prepass is off
+	float BeamStart( const int x, const int y ) const { return beamStart.empty() ? 0 : beamStart[x / BEAM_TILE + (y / BEAM_TILE) * beamTilesX]; }
+	bool PixelActive( const int x, const int y ) const { return tileActive.empty() || tileActive[x / ADAPTIVE_TILE + (y / ADAPTIVE_TILE) * tilesX]; }
+	// add a sample of pixel idx: weighted by the samples the pixel takes this frame, and to its moments
+	void AddSample( const int idx, const float3& sample )
+	{
+		accumulator[idx] += sample * sampleWeight;
+		if (!adaptiveSampling) return;
+		const float l = 0.2126f * sample.x + 0.7152f * sample.y + 0.0722f * sample.z;
+		moments[idx] += float2( l, l * l );
+	}
+	void Reproject();
 	void Tick( float deltaTime );
 	void UI();
-	void LightUI() const;
+	void LightUI();
 	void MaterialUI(const char* label, Material& material);
 	void Shutdown() { /* nothing here for now */ }
 	// input handling
@@ -75,22 +128,50 @@ public:
 	// data members
 	int2 mousePos;
 	float3* accumulator = nullptr;	// for episode 3
-	float3* history;		// for episode 5
-	Scene scene;
+	float3* history = nullptr;		// image of the previous view, reprojected into the current one
+	std::vector<float> beamStart;		// beam prepass: per tile, the distance its primary rays have nothing to hit in
+	int beamTilesX = 0;
+	uint beamSceneVersion = ~0u;		// voxels beamStart was found for
+	std::vector<float> historyDepth;	// gDepth and gFace of the previous view
+	std::vector<uint64_t> historyFace;
+	uint historyLength = 0;				// frames of history the previous view carries over
+	std::vector<float3> gPosition;		// primary hit per pixel, or far along the ray for the sky
+	std::vector<float3> gNormal;		// its voxel normal, zero for the sky
+	std::vector<float3> gAlbedo;		// its material albedo
+	std::vector<float> gDepth;			// its depth along the view axis (see Camera::GetViewMatrix)
+	std::vector<uint64_t> gFace;		// and the voxel face it lies on; both only after reprojection
+	bool gBufferValid = false;			// gPosition was recorded in the last frame
+	Denoiser denoiser;
+	std::vector<float2> moments;		// adaptive: sum of the luminance of the samples of a pixel, and of its square
+	std::vector<uint> tileSamples;		// adaptive: samples per pixel of a tile since the last reset
+	std::vector<uchar> tileActive;		// adaptive: tile has not converged; empty when adaptive sampling is off
+	std::vector<uint> activePixels;		// adaptive: pixels of the active tiles, in scanline order
+	int tilesX = 0, tilesY = 0;
+	float sampleWeight = 1.0f;			// 1 / samplesPerPixel
+	float frameMs = 0;					// adaptive: smoothed trace time of a frame with every pixel active, the budget
+	float msPerSample = 0;				// adaptive: smoothed trace time per sample of an active pixel
+	float sampleBudget = 0;				// adaptive: samples per active pixel left over from earlier frames
+	std::vector<float3> frameSample;	// this frame's sample per pixel (wavefront)
+	RayQueue rayQueue[2];				// wavefront rays: current and next pass
+	ConnectQueue connectQueue;			// wavefront shading points waiting for direct light
+	TileScheduler tileScheduler;
+#ifdef HEADLESS
+	Scene scene;						// the default scene; headless runs map a world only when asked (--world)
+#else
+	Scene scene{ "scene.vxw" };			// saved world if present, like camera.bin; else the default scene
+#endif
 	Camera camera;
 
 
 	// Lights
-	std::vector<Light*> lights;
-	PointLight* pointLight = nullptr;
-	DirectionalLight* dirLight = nullptr;
-	SpotLight* spotLight = nullptr;
-	AreaLight* areaLight = nullptr;
+	LightSet lights;
+	RadianceCache radianceCache;
 
 	bool debugNormals = false;
 
 	uint32_t sampleCount = 0;
-	mat4 lastViewMatrix;
+	uint frameIndex = 0;	// frames since the last reset, also through reprojection; for the light sample sequences
+	mat4 lastViewMatrix;	// camera of the previous frame, for reprojection
 
 	void InitAccumulator();
 
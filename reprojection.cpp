@@ -0,0 +1,132 @@
+#include "template.h"
+
+// Temporal reprojection. When the camera moves, the accumulated image is not thrown away:
+// every pixel of the new view finds its primary hit in the previous view and takes over the
+// average there, as long as the previous view saw the same surface at that spot. The new
+// frame's sample is then blended in with weight 1 / (history + 1), so pixels with a long
+// valid history stay converged and disoccluded pixels start from their first sample.
+// History that the new frame's neighbourhood rules out is clamped away, which removes the
+// trails that jittered edges would otherwise leave behind. The primary hits come for free:
+// the renderer records them in gPosition while it traces.
+
+static constexpr float SKY_DEPTH = 1e30f;		// rays that miss the world end further away than this
+static constexpr float DEPTH_TOLERANCE = 0.03f;	// relative depth difference still seen as the same surface
+
+// the voxel face a primary hit lies on, as 1 + voxel * 6 + axis * 2 + side; 0 for the sky. Faces
+// have a single material, so history is only taken from the same face: blending across faces
+// would smear the edges between voxels a little more with every frame of motion.
+static uint64_t FaceKey( const float3& position, const float3& cameraPosition, const float depth )
+{
+	if (depth > SKY_DEPTH) return 0;
+	// the hit plane is the coordinate closest to a voxel boundary
+	const float3 V = position * (float)WORLDSIZE;
+	const float3 offset = fabs( V - floorf( V + 0.5f ) );
+	const uint axis = offset.x < offset.y ? (offset.x < offset.z ? 0 : 2) : (offset.y < offset.z ? 1 : 2);
+	// the voxel is half a voxel further along the ray
+	const float3 D = normalize( position - cameraPosition );
+	const int3 cell = make_int3( floorf( V + D * 0.5f ) );
+	if (cell.x < 0 || cell.y < 0 || cell.z < 0 || cell.x >= WORLDSIZE || cell.y >= WORLDSIZE || cell.z >= WORLDSIZE) return 0;
+	// 64-bit: 6 faces per voxel overflow 32 bits from WORLDSIZE 1024 on
+	return 1 + ((uint64_t)cell.x + (uint64_t)cell.y * WORLDSIZE + (uint64_t)cell.z * WORLDSIZE2) * 6 + axis * 2 + (D[axis] < 0 ? 1 : 0);
+}
+
+// depth along the view axis and voxel face of every recorded primary hit
+static void ClassifyHits( const std::vector<float3>& position, const mat4& view, std::vector<float>& depth, std::vector<uint64_t>& face )
+{
+	const int N = (int)position.size();
+	const float3 cameraPosition = view.Inverted().TransformPoint( float3( 0 ) );
+	depth.resize( N ), face.resize( N );
+#pragma omp parallel for schedule(static)
+	for (int idx = 0; idx < N; idx++)
+	{
+		depth[idx] = view.TransformPoint( position[idx] ).z;
+		face[idx] = FaceKey( position[idx], cameraPosition, depth[idx] );
+	}
+}
+
+// -----------------------------------------------------------
+// Camera moved: keep the image and primary hits of the previous
+// view, and start this frame from an empty accumulator. Returns
+// false if there is nothing to keep, after resetting the
+// accumulator.
+// -----------------------------------------------------------
+bool Renderer::KeepHistory()
+{
+	const int N = SCRWIDTH * SCRHEIGHT;
+	if (!gBufferValid || sampleCount == 0)
+	{
+		ResetAccumulator();
+		return false;
+	}
+	if (!history) history = static_cast<float3*>MALLOC64( N * sizeof( float3 ) );
+	const float invSampleCount = 1.0f / sampleCount;
+#pragma omp parallel for schedule(static)
+	for (int idx = 0; idx < N; idx++) history[idx] = accumulator[idx] * invSampleCount;
+	ClassifyHits( gPosition, lastViewMatrix, historyDepth, historyFace );
+	historyLength = min( sampleCount, (uint)maxHistory );
+	// not ResetAccumulator: the light sample sequences continue
+	memset( accumulator, 0, N * sizeof( float3 ) );
+	sampleCount = 0;
+	ResetConvergence(); // the pixels see other surfaces now
+	return true;
+}
+
+// -----------------------------------------------------------
+// After rendering a frame that KeepHistory started: fetch the
+// history from the previous view (lastViewMatrix) for the new
+// primary hits and blend this frame's sample into it
+// -----------------------------------------------------------
+void Renderer::Reproject()
+{
+	const int N = SCRWIDTH * SCRHEIGHT;
+	ClassifyHits( gPosition, camera.GetViewMatrix(), gDepth, gFace );
+	// bilinear fetch from the previous view, skipping taps on other surfaces
+	const float K = (float)historyLength;
+	const float voxelDepth = 1.0f / (WORLDSIZE * length( camera.topLeft - camera.camPos ));
+	std::vector<float3> blended( N );
+	float kept = 0;
+#pragma omp parallel for schedule(static) reduction(+:kept)
+	for (int idx = 0; idx < N; idx++)
+	{
+		const float3 Q = lastViewMatrix.TransformPoint( gPosition[idx] );
+		float3 sum( 0 );
+		float valid = 0;
+		if (Q.z > 0)
+		{
+			const uint64_t face = gFace[idx];
+			const float fx = Q.x / Q.z * SCRWIDTH - 0.5f, fy = Q.y / Q.z * SCRHEIGHT - 0.5f;
+			const int x0 = (int)floorf( fx ), y0 = (int)floorf( fy );
+			const float tx = fx - x0, ty = fy - y0;
+			for (int tap = 0; tap < 4; tap++)
+			{
+				const int x = x0 + (tap & 1), y = y0 + (tap >> 1);
+				if (x < 0 || y < 0 || x >= SCRWIDTH || y >= SCRHEIGHT) continue;
+				const float d = historyDepth[x + y * SCRWIDTH];
+				if (historyFace[x + y * SCRWIDTH] != face || (face && fabsf( d - Q.z ) > DEPTH_TOLERANCE * Q.z + voxelDepth)) continue;
+				const float w = ((tap & 1) ? tx : 1 - tx) * ((tap >> 1) ? ty : 1 - ty);
+				sum += w * history[x + y * SCRWIDTH], valid += w;
+			}
+		}
+		kept += valid;
+		const float3 sample = accumulator[idx];
+		if (valid < 0.01f) { blended[idx] = sample; continue; }
+		// clamp the history to the range of this frame's samples around the pixel: where those
+		// agree, e.g. on the sky, nothing that was dragged along at an edge survives
+		const int x = idx % SCRWIDTH, y = idx / SCRWIDTH;
+		float3 lo = sample, hi = sample;
+		for (int v = max( 0, y - 1 ); v <= min( SCRHEIGHT - 1, y + 1 ); v++) for (int u = max( 0, x - 1 ); u <= min( SCRWIDTH - 1, x + 1 ); u++)
+			lo = fminf( lo, accumulator[u + v * SCRWIDTH] ), hi = fmaxf( hi, accumulator[u + v * SCRWIDTH] );
+		// partially valid footprints keep a proportional part of the history
+		const float w = valid * K;
+		blended[idx] = (clamp( sum * (1.0f / valid), lo, hi ) * w + sample) * (1.0f / (w + 1));
+	}
+	// the accumulator is scaled so that, divided by sampleCount as usual, it shows the blend
+	sampleCount = historyLength + 1;
+#pragma omp parallel for schedule(static)
+	for (int idx = 0; idx < N; idx++)
+	{
+		accumulator[idx] = blended[idx] * (float)sampleCount;
+		screen->pixels[idx] = RGBF32_to_RGB8( blended[idx] );
+	}
+	reprojectedFraction = kept / N;
+}
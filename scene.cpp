@@ -1,8 +1,10 @@
 #include "template.h"
 
 #include "Core/Material.h"
-
-#include "Core/Material.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
 
 inline float intersect_cube(Ray& ray)
 {
@@ -24,10 +26,22 @@ inline bool point_in_cube(const float3& pos)
 		pos.x <= 1 && pos.y <= 1 && pos.z <= 1;
 }
 
-Scene::Scene()
+Scene::Scene(const char* file)
 {
-    grid = (uint*)MALLOC64(WORLDSIZE3 * sizeof(uint));
-    memset(grid, 0, WORLDSIZE3 * sizeof(uint));
+    // coarse levels of the occupancy pyramid
+    for (topLevel = 0; (2 << topLevel) < WORLDSIZE; topLevel++);
+    for (int level = 4; level <= topLevel; level++)
+    {
+        const size_t cells = (size_t)(WORLDSIZE >> level) * (WORLDSIZE >> level) * (WORLDSIZE >> level);
+        occupancy[level].resize((cells + 63) / 64, 0);
+    }
+
+    // a saved world is used as is
+    if (file && Map(file)) return;
+
+    // top level of the brick map; bricks are allocated on demand by Set
+    grid = (uint*)MALLOC64(GRIDSIZE3 * sizeof(uint));
+    memset(grid, 0, GRIDSIZE3 * sizeof(uint));
 
     // Initialize materials
     materials.fill(Material{});
@@ -69,9 +83,8 @@ Scene::Scene()
         for (int x = 0; x < WORLDSIZE; x++)
             for (int y = 0; y < 8; y++)
             {
-                int idx = x + y * WORLDSIZE + z * WORLDSIZE2;
                 bool isWhite = ((x / 8) + (z / 8)) % 2 == 0;
-                grid[idx] = isWhite ? MAT_LAMBERTIAN_WHITE : MAT_LAMBERTIAN_GRAY;
+                Set(x, y, z, isWhite ? MAT_LAMBERTIAN_WHITE : MAT_LAMBERTIAN_GRAY);
             }
 
     auto createSphere = [&](int cx, int cy, int cz, int r, MaterialID mat) {
@@ -85,8 +98,7 @@ Scene::Scene()
                         int pz = cz + z;
                         if (px < 0 || py < 0 || pz < 0 ||
                             px >= WORLDSIZE || py >= WORLDSIZE || pz >= WORLDSIZE) continue;
-                        int idx = px + py * WORLDSIZE + pz * WORLDSIZE2;
-                        grid[idx] = mat;
+                        Set(px, py, pz, mat);
                     }
         };
 
@@ -101,7 +113,7 @@ Scene::Scene()
             for (int y = y1; y < y1 + size; y++)
                 for (int x = x1; x < x1 + size; x++)
                     if (x >= 0 && y >= 0 && z >= 0 && x < WORLDSIZE && y < WORLDSIZE && z < WORLDSIZE)
-                        grid[x + y * WORLDSIZE + z * WORLDSIZE2] = mat;
+                        Set(x, y, z, mat);
         };
 
     createCube(20, 8, 20, 10, MAT_RED);    // Red cube
@@ -113,14 +125,476 @@ Scene::Scene()
         for (int x = 0; x < WORLDSIZE; x++)
         {
             int z = WORLDSIZE - 1;
-            int idx = x + y * WORLDSIZE + z * WORLDSIZE2;
-            grid[idx] = MAT_MIRROR;
+            Set(x, y, z, MAT_MIRROR);
         }
 }
 
+void Scene::Clear()
+{
+	// empty the world; the brick pool keeps its capacity, for scenes that are rebuilt often
+	version++;
+	memset(grid, 0, GRIDSIZE3 * sizeof(uint));
+	brickCount = 0;
+	freeBricks.clear();
+	for (int level = 4; level <= topLevel; level++) std::fill(occupancy[level].begin(), occupancy[level].end(), 0);
+	materialCount = MAT_COUNT;
+	palette.clear();
+}
+
+uint Scene::MaterialForColor(const uint rgb)
+{
+	// one Lambertian material per palette color; when the table is full, reuse the closest color.
+	// The candidates are the materials in index order, not the palette, whose hash map order
+	// would make the choice, and so the loaded world, differ between runs and platforms
+	auto it = palette.find(rgb);
+	if (it != palette.end()) return it->second;
+	const float3 albedo((rgb >> 16) & 255, (rgb >> 8) & 255, rgb & 255);
+	uint idx = materialCount;
+	if (materialCount < MAX_MATERIALS)
+	{
+		materials[idx] = Material{};
+		materials[idx].albedo = albedo * (1.0f / 255.0f);
+		materialCount++;
+	}
+	else
+	{
+		float best = 1e34f;
+		for (uint i = MAT_COUNT; i < MAX_MATERIALS; i++)
+		{
+			const float3 d = albedo - materials[i].albedo * 255.0f;
+			if (dot(d, d) < best) best = dot(d, d), idx = i;
+		}
+	}
+	palette[rgb] = idx;
+	return idx;
+}
+
+bool Scene::ReadModelHeader(const string& file, gzFile f, int3& size)
+{
+	int header[3];
+	if (gzread(f, header, sizeof(header)) != sizeof(header) || header[0] <= 0 || header[1] <= 0 || header[2] <= 0) return false;
+	size = make_int3(header[0], header[1], header[2]);
+	// the header has a padding int if the decompressed length, which the gzip trailer holds
+	// modulo 2^32 (ISIZE), is 16 bytes more than the voxels take
+	uint isize = 0;
+	FILE* raw = fopen(file.c_str(), "rb");
+	if (raw)
+	{
+		if (fseek(raw, -4, SEEK_END) || fread(&isize, sizeof(isize), 1, raw) != 1) isize = 0;
+		fclose(raw);
+	}
+	const uint voxelBytes = (uint)((uint64_t)size.x * size.y * size.z * sizeof(uint));
+	int padding;
+	if (isize == voxelBytes + 16 && gzread(f, &padding, sizeof(padding)) != sizeof(padding)) return false;
+	return true;
+}
+
+bool Scene::StreamModel(const ModelPlacement& model, std::mutex& lock)
+{
+	// decompress in chunks; solid voxels of a chunk are written to the world in one go, under
+	// 'lock', so that other models can decompress in the meantime
+	gzFile f = gzopen(model.file.c_str(), "rb");
+	if (!f) return false;
+	gzbuffer(f, 1 << 17);
+	int3 size;
+	if (!ReadModelHeader(model.file, f, size)) { gzclose(f); return false; }
+	struct Solid { int x, y, z; uint rgb; };
+	const int CHUNK = 16384;
+	std::vector<uint> chunk(CHUNK);
+	std::vector<Solid> solid;
+	solid.reserve(CHUNK);
+	const int64_t total = (int64_t)size.x * size.y * size.z;
+	int x = 0, y = 0, z = 0;
+	for (int64_t done = 0; done < total;)
+	{
+		const int n = (int)min((int64_t)CHUNK, total - done);
+		if (gzread(f, chunk.data(), n * sizeof(uint)) != (int)(n * sizeof(uint))) { gzclose(f); return false; }
+		solid.clear();
+		for (int i = 0; i < n; i++)
+		{
+			// a voxel is 0xRRGGBB; the top byte is ignored (some exporters keep flags there), and
+			// RGB 0 is empty, so a voxel is solid exactly when it gets a color
+			const uint rgb = chunk[i] & 0xffffff;
+			if (rgb) solid.push_back({ x, y, z, rgb });
+			if (++x == size.x) { x = 0; if (++y == size.y) y = 0, z++; }
+		}
+		done += n;
+		if (solid.empty()) continue;
+		std::lock_guard<std::mutex> guard(lock);
+		uint lastColor = ~0u, mat = 0; // ~0u is no color, so the first voxel finds its material
+		for (const Solid& v : solid)
+		{
+			if (v.rgb != lastColor) lastColor = v.rgb, mat = MaterialForColor(v.rgb);
+			// a model voxel covers world voxels [floor(c * scale), floor((c + 1) * scale)), at least one
+			const int3 lo = model.position + make_int3((int)floorf(v.x * model.scale), (int)floorf(v.y * model.scale), (int)floorf(v.z * model.scale));
+			const int3 hi = max(lo + 1, model.position + make_int3((int)floorf((v.x + 1) * model.scale), (int)floorf((v.y + 1) * model.scale), (int)floorf((v.z + 1) * model.scale)));
+			for (int wz = max(lo.z, 0); wz < min(hi.z, WORLDSIZE); wz++)
+				for (int wy = max(lo.y, 0); wy < min(hi.y, WORLDSIZE); wy++)
+					for (int wx = max(lo.x, 0); wx < min(hi.x, WORLDSIZE); wx++) Set(wx, wy, wz, mat);
+		}
+	}
+	gzclose(f);
+	return true;
+}
+
+bool Scene::LoadModel(const ModelPlacement& model)
+{
+	std::mutex lock;
+	return StreamModel(model, lock);
+}
+
+int Scene::LoadModels(const std::vector<ModelPlacement>& models)
+{
+	// one model per thread; decompression runs in parallel, writing to the world does not.
+	// Where models overlap, the voxel of the model that was written last remains.
+	std::mutex lock;
+	int loaded = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:loaded)
+	for (int i = 0; i < (int)models.size(); i++) if (StreamModel(models[i], lock)) loaded++;
+	return loaded;
+}
+
+// world file header; the sections follow in this order, at 64-byte aligned offsets. The grid
+// and the bricks are stored as they are in memory, so the magic tells the voxel layout
+#if VOXEL_LAYOUT == LAYOUT_MORTON
+static const char WORLD_MAGIC[4] = { 'V', 'X', 'M', '2' };
+#else
+static const char WORLD_MAGIC[4] = { 'V', 'X', 'W', '2' };
+#endif
+struct WorldFileHeader
+{
+	char magic[4];				// WORLD_MAGIC
+	uint worldSize, brickSize;	// must match WORLDSIZE and BRICKSIZE
+	uint topLevel;				// coarsest occupancy level
+	uint materialSize;			// sizeof(Material), must match
+	uint voxelSize;				// sizeof(Voxel), must match
+	uint brickCount, materialCount, paletteCount;
+	uint64_t grid, brick, voxelMask, brickVoxels, brickMask, occupancy, materials, palette, fileSize; // offsets
+};
+
+bool Scene::Save(const char* file) const
+{
+	// bricks are renumbered in grid order, so released bricks are not stored
+	std::vector<uint> newGrid(GRIDSIZE3, 0), order;
+	for (int i = 0; i < GRIDSIZE3; i++) if (grid[i]) order.push_back(grid[i] - 1), newGrid[i] = (uint)order.size();
+	size_t occupancyWords = 0;
+	for (int level = 4; level <= topLevel; level++) occupancyWords += occupancy[level].size();
+	WorldFileHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, WORLD_MAGIC, 4);
+	h.worldSize = WORLDSIZE, h.brickSize = BRICKSIZE, h.topLevel = topLevel, h.materialSize = sizeof(Material), h.voxelSize = sizeof(Voxel);
+	h.brickCount = (uint)order.size(), h.materialCount = materialCount, h.paletteCount = (uint)palette.size();
+	uint64_t pos = sizeof(h);
+	auto section = [&](const uint64_t bytes) { const uint64_t start = (pos + 63) & ~63ull; pos = start + bytes; return start; };
+	h.grid = section(GRIDSIZE3 * sizeof(uint));
+	h.brick = section((uint64_t)h.brickCount * BRICKSIZE3 * sizeof(Voxel));
+	h.voxelMask = section((uint64_t)h.brickCount * MASKWORDS * sizeof(uint64_t));
+	h.brickVoxels = section(h.brickCount * sizeof(ushort));
+	h.brickMask = section(h.brickCount * sizeof(uint64_t));
+	h.occupancy = section(occupancyWords * sizeof(uint64_t));
+	h.materials = section(materialCount * sizeof(Material));
+	h.palette = section(palette.size() * 2 * sizeof(uint));
+	h.fileSize = pos;
+	FILE* f = fopen(file, "wb");
+	if (!f) return false;
+	uint64_t written = 0;
+	auto write = [&](const uint64_t offset, const void* data, const size_t bytes)
+	{
+		static const uchar zeroes[64] = {};
+		while (written < offset) written += fwrite(zeroes, 1, (size_t)min<uint64_t>(64, offset - written), f);
+		if (bytes) written += fwrite(data, 1, bytes, f);
+	};
+	write(0, &h, sizeof(h));
+	write(h.grid, newGrid.data(), GRIDSIZE3 * sizeof(uint));
+	for (uint i = 0; i < h.brickCount; i++) write(h.brick + (uint64_t)i * BRICKSIZE3 * sizeof(Voxel), brick + (size_t)order[i] * BRICKSIZE3, BRICKSIZE3 * sizeof(Voxel));
+	for (uint i = 0; i < h.brickCount; i++) write(h.voxelMask + (uint64_t)i * MASKWORDS * sizeof(uint64_t), voxelMask + (size_t)order[i] * MASKWORDS, MASKWORDS * sizeof(uint64_t));
+	for (uint i = 0; i < h.brickCount; i++) write(h.brickVoxels + i * sizeof(ushort), brickVoxels + order[i], sizeof(ushort));
+	for (uint i = 0; i < h.brickCount; i++) write(h.brickMask + i * sizeof(uint64_t), brickMask + order[i], sizeof(uint64_t));
+	for (int level = 4, words = 0; level <= topLevel; words += (int)occupancy[level].size(), level++)
+		write(h.occupancy + words * sizeof(uint64_t), occupancy[level].data(), occupancy[level].size() * sizeof(uint64_t));
+	write(h.materials, materials.data(), materialCount * sizeof(Material));
+	uint64_t offset = h.palette;
+	for (const auto& entry : palette) { const uint pair[2] = { entry.first, entry.second }; write(offset, pair, sizeof(pair)), offset += sizeof(pair); }
+	write(h.fileSize, 0, 0);
+	const bool ok = written == h.fileSize;
+	fclose(f);
+	return ok;
+}
+
+bool Scene::Map(const char* file)
+{
+	// map the whole file copy-on-write; nothing is read yet, except for the header
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	const size_t size = (size_t)fileSize.QuadPart;
+	HANDLE mappingHandle = size >= sizeof(WorldFileHeader) ? CreateFileMappingA(fileHandle, 0, PAGE_WRITECOPY, 0, 0, 0) : 0;
+	uchar* data = mappingHandle ? (uchar*)MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0) : 0;
+	if (mappingHandle) CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	if (!data) return false;
+	auto unmap = [](uchar* p, size_t) { UnmapViewOfFile(p); };
+#else
+	const int fd = open(file, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	const size_t size = fstat(fd, &info) == 0 ? (size_t)info.st_size : 0;
+	void* view = size >= sizeof(WorldFileHeader) ? mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (view == MAP_FAILED) return false;
+	uchar* data = (uchar*)view;
+	auto unmap = [](uchar* p, size_t bytes) { munmap(p, bytes); };
+#endif
+	WorldFileHeader h;
+	memcpy(&h, data, sizeof(h));
+	bool valid = !memcmp(h.magic, WORLD_MAGIC, 4) && h.worldSize == WORLDSIZE && h.brickSize == BRICKSIZE && h.topLevel == (uint)topLevel &&
+		h.materialSize == sizeof(Material) && h.voxelSize == sizeof(Voxel) && h.materialCount <= MAX_MATERIALS && h.fileSize <= size;
+	// a truncated or corrupt file must not send the traversal outside the mapping: every section
+	// lies inside the file, every brick map entry names a stored brick, every palette entry a
+	// material
+	size_t occupancyWords = 0;
+	for (int level = 4; level <= topLevel; level++) occupancyWords += occupancy[level].size();
+	auto fits = [&](const uint64_t offset, const uint64_t count, const uint64_t elementSize)
+	{
+		return (offset & 63) == 0 && offset <= size && count <= (size - offset) / elementSize;
+	};
+	valid = valid && fits(h.grid, GRIDSIZE3, sizeof(uint)) && fits(h.brick, (uint64_t)h.brickCount * BRICKSIZE3, sizeof(Voxel)) &&
+		fits(h.voxelMask, (uint64_t)h.brickCount * MASKWORDS, sizeof(uint64_t)) && fits(h.brickVoxels, h.brickCount, sizeof(ushort)) &&
+		fits(h.brickMask, h.brickCount, sizeof(uint64_t)) && fits(h.occupancy, occupancyWords, sizeof(uint64_t)) &&
+		fits(h.materials, h.materialCount, sizeof(Material)) && fits(h.palette, (uint64_t)h.paletteCount * 2, sizeof(uint));
+	const uint* entries = (const uint*)(data + h.grid);
+	for (int i = 0; valid && i < GRIDSIZE3; i++) valid = entries[i] <= h.brickCount;
+	const uint* pairs = (const uint*)(data + h.palette);
+	for (uint i = 0; valid && i < h.paletteCount; i++) valid = pairs[i * 2 + 1] < h.materialCount;
+	if (!valid)
+	{
+		unmap(data, size);
+		return false;
+	}
+	// replace the current world
+	ReleaseStorage();
+	mapping = data, mappingSize = size;
+	grid = (uint*)(data + h.grid);
+	brick = (Voxel*)(data + h.brick);
+	voxelMask = (uint64_t*)(data + h.voxelMask);
+	brickVoxels = (ushort*)(data + h.brickVoxels);
+	brickMask = (uint64_t*)(data + h.brickMask);
+	brickCount = brickCapacity = h.brickCount;
+	freeBricks.clear();
+	// small sections are copied: the occupancy levels, materials and palette
+	const uint64_t* words = (const uint64_t*)(data + h.occupancy);
+	for (int level = 4; level <= topLevel; words += occupancy[level].size(), level++)
+		memcpy(occupancy[level].data(), words, occupancy[level].size() * sizeof(uint64_t));
+	materials.fill(Material{});
+	memcpy(materials.data(), data + h.materials, h.materialCount * sizeof(Material));
+	materialCount = h.materialCount;
+	palette.clear();
+	for (uint i = 0; i < h.paletteCount; i++) palette[pairs[i * 2]] = pairs[i * 2 + 1];
+	version++;
+	return true;
+}
+
+void Scene::ReleaseStorage()
+{
+	if (!InMapping(grid)) FREE64(grid);
+	if (!InMapping(brick)) FREE64(brick), FREE64(voxelMask), FREE64(brickVoxels), FREE64(brickMask);
+	grid = nullptr, brick = nullptr, voxelMask = nullptr, brickVoxels = nullptr, brickMask = nullptr;
+	brickCount = brickCapacity = 0;
+	if (!mapping) return;
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+#else
+	munmap(mapping, mappingSize);
+#endif
+	mapping = nullptr, mappingSize = 0;
+}
+
+uint Scene::AllocateBrick()
+{
+	// reuse a released brick if we have one
+	uint idx;
+	if (!freeBricks.empty()) idx = freeBricks.back(), freeBricks.pop_back(); else
+	{
+		if (brickCount == brickCapacity)
+		{
+			// grow the pool; note: not thread-safe, so don't call Set while rendering
+			const uint newCapacity = max(256u, brickCapacity * 2);
+			// 64 bytes to spare: Traverse8 reads 8-bit voxels with 32-bit gathers
+			Voxel* newBrick = (Voxel*)MALLOC64((size_t)newCapacity * BRICKSIZE3 * sizeof(Voxel) + 64);
+			uint64_t* newVoxelMask = (uint64_t*)MALLOC64((size_t)newCapacity * MASKWORDS * sizeof(uint64_t));
+			ushort* newVoxels = (ushort*)MALLOC64(newCapacity * sizeof(ushort));
+			uint64_t* newMask = (uint64_t*)MALLOC64(newCapacity * sizeof(uint64_t));
+			if (brickCount)
+			{
+				memcpy(newBrick, brick, (size_t)brickCount * BRICKSIZE3 * sizeof(Voxel));
+				memcpy(newVoxelMask, voxelMask, (size_t)brickCount * MASKWORDS * sizeof(uint64_t));
+				memcpy(newVoxels, brickVoxels, brickCount * sizeof(ushort));
+				memcpy(newMask, brickMask, brickCount * sizeof(uint64_t));
+				// arrays in a mapped world file stay where they are, until the file is unmapped
+				if (!InMapping(brick)) FREE64(brick), FREE64(voxelMask), FREE64(brickVoxels), FREE64(brickMask);
+			}
+			brick = newBrick, voxelMask = newVoxelMask, brickVoxels = newVoxels, brickMask = newMask, brickCapacity = newCapacity;
+		}
+		idx = brickCount++;
+	}
+	memset(brick + (size_t)idx * BRICKSIZE3, 0, BRICKSIZE3 * sizeof(Voxel));
+	memset(voxelMask + (size_t)idx * MASKWORDS, 0, MASKWORDS * sizeof(uint64_t));
+	brickVoxels[idx] = 0;
+	brickMask[idx] = 0;
+	return idx;
+}
+
 void Scene::Set(const uint x, const uint y, const uint z, const uint v)
 {
-	grid[x + y * WORLDSIZE + z * WORLDSIZE2] = v;
+	// v must fit a Voxel; in release builds a larger one is truncated, and the mask, the counts
+	// and the pyramid follow the truncated value, so they always agree with what is stored
+	assert((uint)(Voxel)v == v);
+	const Voxel value = (Voxel)v;
+	version++;
+	uint& b = grid[GridIndex(x / BRICKSIZE, y / BRICKSIZE, z / BRICKSIZE)];
+	if (!b)
+	{
+		if (!value) return; // clearing a voxel in an empty brick
+		b = AllocateBrick() + 1;
+	}
+	const uint offset = BrickOffset(x, y, z);
+	Voxel& voxel = brick[(size_t)(b - 1) * BRICKSIZE3 + offset];
+	uint64_t& bits = voxelMask[(size_t)(b - 1) * MASKWORDS + offset / 64];
+	if (value && !voxel) brickVoxels[b - 1]++;
+	if (!value && voxel) brickVoxels[b - 1]--;
+	voxel = value;
+	if (value) bits |= 1ull << (offset & 63); else bits &= ~(1ull << (offset & 63));
+	// keep the occupancy pyramid up to date
+	if (value)
+	{
+		brickMask[b - 1] |= 1ull << (((x & 7) >> 1) + ((y & 7) >> 1) * 4 + ((z & 7) >> 1) * 16);
+		for (int level = 4; level <= topLevel; level++)
+		{
+			const size_t n = WORLDSIZE >> level, idx = (x >> level) + (y >> level) * n + (z >> level) * n * n;
+			occupancy[level][idx >> 6] |= 1ull << (idx & 63);
+		}
+	}
+	// release bricks that became empty, so the DDA skips them again
+	if (brickVoxels[b - 1] == 0) freeBricks.push_back(b - 1), b = 0;
+	if (!value) ClearOccupancy(x, y, z);
+}
+
+void Scene::ClearOccupancy(const uint x, const uint y, const uint z)
+{
+	// a voxel was cleared: recompute pyramid levels bottom-up, until a level stays occupied
+	const uint b = grid[GridIndex(x / BRICKSIZE, y / BRICKSIZE, z / BRICKSIZE)];
+	if (b)
+	{
+		// level 1: the 2x2x2 block of the voxel
+		const uint64_t* bits = voxelMask + (size_t)(b - 1) * MASKWORDS;
+		const uint bx = x & 6, by = y & 6, bz = z & 6;
+		uint64_t solid = 0;
+		for (uint i = 0; i < 8; i++)
+		{
+			const uint offset = BrickOffset(bx + (i & 1), by + ((i >> 1) & 1), bz + (i >> 2));
+			solid |= (bits[offset / 64] >> (offset & 63)) & 1;
+		}
+		if (!solid) brickMask[b - 1] &= ~(1ull << ((bx >> 1) + (by >> 1) * 4 + (bz >> 1) * 16));
+		return; // brick still occupied, so are all coarser levels
+	}
+	for (int level = 4; level <= topLevel; level++)
+	{
+		const int3 C = make_int3(x >> level, y >> level, z >> level);
+		bool occupied = false;
+		for (int i = 0; i < 8; i++) occupied |= Occupied(level - 1, make_int3(C.x * 2 + (i & 1), C.y * 2 + ((i >> 1) & 1), C.z * 2 + (i >> 2)) << (level - 1));
+		if (occupied) return;
+		const size_t n = WORLDSIZE >> level, idx = C.x + C.y * n + C.z * n * n;
+		occupancy[level][idx >> 6] &= ~(1ull << (idx & 63));
+	}
+}
+
+bool Scene::Occupied(const int level, const int3& P) const
+{
+	// true if the level-'level' block containing voxel P holds at least one solid voxel
+	if (level >= 4)
+	{
+		const size_t n = WORLDSIZE >> level, idx = (P.x >> level) + (P.y >> level) * n + (P.z >> level) * n * n;
+		return (occupancy[level][idx >> 6] >> (idx & 63)) & 1;
+	}
+	const uint b = grid[GridIndex(P.x >> 3, P.y >> 3, P.z >> 3)];
+	if (level == 3 || !b) return b != 0;
+	const int x = P.x & 7, y = P.y & 7, z = P.z & 7;
+	if (level == 2) return (brickMask[b - 1] >> (((x >> 2) * 2) + ((y >> 2) * 8) + ((z >> 2) * 32))) & 0x330033;
+	if (level == 1) return (brickMask[b - 1] >> ((x >> 1) + (y >> 1) * 4 + (z >> 1) * 16)) & 1;
+	const uint offset = BrickOffset(x, y, z);
+	return (voxelMask[(size_t)(b - 1) * MASKWORDS + offset / 64] >> (offset & 63)) & 1;
+}
+
+uint Scene::TraversePyramid(const Ray& ray, int3 P, float& t, uint& axis, const float tlimit, uint& steps) const
+{
+	// work in voxel space, where every voxel is 1x1x1
+	const float3 O = ray.O * (float)WORLDSIZE, D = ray.D * (float)WORLDSIZE;
+	const float3 rD = ray.rD * (1.0f / WORLDSIZE), dirMask = 1.0f - ray.Dsign;
+	int level = topLevel;
+	while (t < tlimit)
+	{
+		steps++;
+		// find the largest empty block around P; levels above 'level' are known to be occupied
+		while (level >= 0 && Occupied(level, P)) level--;
+		if (level < 0) return Get(P.x, P.y, P.z);
+		// skip it in a single step
+		const int3 prev = P;
+		ExitCell(O, D, rD, dirMask, 1 << level, P, t, axis);
+		if ((uint)P.x >= WORLDSIZE || (uint)P.y >= WORLDSIZE || (uint)P.z >= WORLDSIZE) return 0;
+		// blocks that still contain P stay occupied; restart at the largest block we left
+		const uint diff = (P.x ^ prev.x) | (P.y ^ prev.y) | (P.z ^ prev.z);
+		int highBit = 0;
+		while (diff >> (highBit + 1)) highBit++;
+		level = min(highBit, topLevel);
+	}
+	return 0;
+}
+
+float Scene::ConeFreeDistance(const float3& O, const float3& D, const float slope) const
+{
+	// march along the axis with growing steps. The part of the cone between t and t + dt lies in
+	// the bounds of that stretch of the axis, widened by the radius at t + dt; those bounds are
+	// tested against the level of the pyramid where they span at most 2 blocks per axis. An
+	// occupied box halves the step, until it is below a voxel.
+	const float3 far = float3(O.x < 0.5f ? 1.0f : 0.0f, O.y < 0.5f ? 1.0f : 0.0f, O.z < 0.5f ? 1.0f : 0.0f);
+	const float tfar = length(far - O); // beyond this, the cone is out of the world
+	const float minStep = 0.5f / WORLDSIZE;
+	float t = 0, dt = minStep;
+	while (t < tfar)
+	{
+		const float r = (t + dt) * slope + 1e-5f;
+		const float3 A = O + t * D, B = O + (t + dt) * D;
+		const float3 lo = (fminf(A, B) - r) * (float)WORLDSIZE, hi = (fmaxf(A, B) + r) * (float)WORLDSIZE;
+		const int3 L = max(make_int3(floorf(lo)), make_int3(0)), H = min(make_int3(floorf(hi)), make_int3(WORLDSIZE - 1));
+		bool occupied = false;
+		if (L.x <= H.x && L.y <= H.y && L.z <= H.z)
+		{
+			const int extent = max(H.x - L.x, max(H.y - L.y, H.z - L.z)) + 1;
+			int level = 0;
+			while ((1 << level) < extent && level < topLevel) level++;
+			for (int z = L.z >> level; z <= H.z >> level && !occupied; z++)
+				for (int y = L.y >> level; y <= H.y >> level && !occupied; y++)
+					for (int x = L.x >> level; x <= H.x >> level && !occupied; x++)
+						occupied = Occupied(level, make_int3(x << level, y << level, z << level));
+		}
+		if (!occupied) t += dt, dt *= 2;
+		else if (dt > minStep) dt *= 0.5f;
+		else break;
+	}
+	return t;
+}
+
+void Scene::Commit()
+{
+	// bring the active backend up to date with the voxel data; call between frames, never while tracing
+	if (backend == TREE64 && treeVersion != version) tree.Build(*this), treeVersion = version;
+}
+
+size_t Scene::MemoryUsage() const
+{
+	return GRIDSIZE3 * sizeof(uint) + (size_t)brickCapacity * (BRICKSIZE3 * sizeof(Voxel) + MASKWORDS * sizeof(uint64_t) + sizeof(ushort));
 }
 
 bool Scene::Setup3DDDA(Ray& ray, DDAState& state) const
@@ -133,6 +607,12 @@ bool Scene::Setup3DDDA(Ray& ray, DDAState& state) const
 		state.t = intersect_cube(ray);
 		if (state.t > 1e33f) return false; // ray misses voxel data entirely
 	}
+	if (ray.tstart > 0 && ray.tstart > state.t)
+	{
+		// nothing to hit before tstart (beam prepass): start there, unless the ray left the world
+		state.t = ray.tstart, startedInGrid = false;
+		if (!point_in_cube(ray.O + state.t * ray.D)) return false;
+	}
 	// setup amanatides & woo - assume world is 1x1x1, from (0,0,0) to (1,1,1)
 	static const float cellSize = 1.0f / WORLDSIZE;
 	state.step = make_int3(1.0f - ray.Dsign * 2.0f);
@@ -143,12 +623,37 @@ bool Scene::Setup3DDDA(Ray& ray, DDAState& state) const
 	state.tdelta = cellSize * float3(state.step) * ray.rD;
 	state.tmax = (gridPlanes - ray.O) * ray.rD;
 	// detect rays that start inside a voxel
-	uint cell = grid[P.x + P.y * WORLDSIZE + P.z * WORLDSIZE2];
+	uint cell = Get(P.x, P.y, P.z);
 	ray.inside = cell != 0 && startedInGrid;
 	// proceed with traversal
 	return true;
 }
 
+void Scene::SetupBrickDDA(const Ray& ray, DDAState& state) const
+{
+	// same as Setup3DDDA, but with bricks as cells; expects state.t at the grid entry point
+	static const float brickSize = (float)BRICKSIZE / WORLDSIZE;
+	state.step = make_int3(1.0f - ray.Dsign * 2.0f);
+	const float3 posInGrid = (float)GRIDSIZE * (ray.O + (state.t + 0.00005f) * ray.D);
+	const float3 gridPlanes = (ceilf(posInGrid) - ray.Dsign) * brickSize;
+	const int3 P = clamp(make_int3(posInGrid), 0, GRIDSIZE - 1);
+	state.X = P.x, state.Y = P.y, state.Z = P.z;
+	state.tdelta = brickSize * float3(state.step) * ray.rD;
+	state.tmax = (gridPlanes - ray.O) * ray.rD;
+}
+
+void Scene::EnterBrick(const Ray& ray, const DDAState& b, const uint axis, uint& X, uint& Y, uint& Z) const
+{
+	// first voxel of brick b along the ray: exact on the axis of the plane we just crossed,
+	// from the entry point on the other two. Rounding a position nudged past the plane, as the
+	// brick map walk first did, can land one voxel off near brick edges and corners.
+	const float3 pos = (float)WORLDSIZE * (ray.O + b.t * ray.D);
+	const int x0 = b.X * BRICKSIZE, y0 = b.Y * BRICKSIZE, z0 = b.Z * BRICKSIZE;
+	X = axis == 0 ? (b.step.x > 0 ? x0 : x0 + BRICKSIZE - 1) : clamp((int)pos.x, x0, x0 + BRICKSIZE - 1);
+	Y = axis == 1 ? (b.step.y > 0 ? y0 : y0 + BRICKSIZE - 1) : clamp((int)pos.y, y0, y0 + BRICKSIZE - 1);
+	Z = axis == 2 ? (b.step.z > 0 ? z0 : z0 + BRICKSIZE - 1) : clamp((int)pos.z, z0, z0 + BRICKSIZE - 1);
+}
+
 void Scene::FindNearest(Ray& ray) const
 {
     // Nudge origin to avoid self-intersection
@@ -167,7 +672,8 @@ void Scene::FindNearest(Ray& ray) const
         // Ray starts inside a filled voxel, step until we find empty space
         while (true)
         {
-            cell = grid[s.X + s.Y * WORLDSIZE + s.Z * WORLDSIZE2];
+            ray.steps++;
+            cell = Get(s.X, s.Y, s.Z);
             if (!cell) break; // found empty space
 
             lastCell = cell;
@@ -227,8 +733,7 @@ void Scene::FindNearest(Ray& ray) const
                 hitY >= 0 && hitY < WORLDSIZE &&
                 hitZ >= 0 && hitZ < WORLDSIZE)
             {
-                int idx = hitX + hitY * WORLDSIZE + hitZ * WORLDSIZE2;
-                ray.materialIndex = grid[idx];
+                ray.materialIndex = Get(hitX, hitY, hitZ);
             }
             else
             {
@@ -236,91 +741,499 @@ void Scene::FindNearest(Ray& ray) const
             }
         }
     }
+    else if (backend != BRICKMAP)
+    {
+        // Ray starts outside, skip empty space in steps as large as the pyramid or the 64-tree allow
+        float t = s.t;
+        const int3 P = make_int3(s.X, s.Y, s.Z);
+        if (backend == TREE64) cell = tree.Traverse(ray, P, t, axis, 1e34f, ray.steps);
+        else cell = TraversePyramid(ray, P, t, axis, 1e34f, ray.steps);
+        if (!cell) return;
+        ray.voxel = cell;
+        ray.materialIndex = cell;
+        ray.t = t;
+        ray.axis = axis;
+        return;
+    }
+    else if (octantKernels)
+    {
+        // the same walk as below, specialized on the direction octant of the ray
+        float t = s.t;
+        uint steps = 0;
+        cell = WalkBricks(ray, s, t, axis, 1e34f, steps, false);
+        ray.steps += steps;
+        if (!cell) return;
+        ray.voxel = cell;
+        ray.materialIndex = cell;
+        ray.t = t;
+        ray.axis = axis;
+        return;
+    }
     else
     {
-        // Ray starts outside, step until we hit a filled voxel
-        while (true)
+        // Ray starts outside, step over the bricks and only walk the voxels of occupied ones
+        DDAState b;
+        b.t = s.t;
+        SetupBrickDDA(ray, b);
+        static const float cellSize = 1.0f / WORLDSIZE;
+        const float3 tdelta = s.tdelta;
+        uint steps = 0;
+        for (bool first = true;; first = false)
         {
-            cell = grid[s.X + s.Y * WORLDSIZE + s.Z * WORLDSIZE2];
-            if (cell) break; // hit voxel
-
-            // Advance to next voxel
-            if (s.tmax.x < s.tmax.y)
+            steps++;
+            uint exitAxis = 3;
+            const uint brickIdx = grid[GridIndex(b.X, b.Y, b.Z)];
+            if (brickIdx)
             {
-                if (s.tmax.x < s.tmax.z)
+                // voxel-level DDA inside the brick, starting where the ray entered it
+                const Voxel* voxels = brick + (size_t)(brickIdx - 1) * BRICKSIZE3;
+                uint X = s.X, Y = s.Y, Z = s.Z;
+                if (!first) EnterBrick(ray, b, axis, X, Y, Z);
+                float3 tmax = (float3((float)X, (float)Y, (float)Z) + 1.0f - ray.Dsign) * cellSize;
+                tmax = (tmax - ray.O) * ray.rD;
+                float t = b.t;
+                uint voxelAxis = axis;
+                while (true)
                 {
-                    s.t = s.tmax.x;
-                    s.X += s.step.x;
-                    axis = 0;
-                    if (s.X >= WORLDSIZE) return;
-                    s.tmax.x += s.tdelta.x;
-                }
-                else
-                {
-                    s.t = s.tmax.z;
-                    s.Z += s.step.z;
-                    axis = 2;
-                    if (s.Z >= WORLDSIZE) return;
-                    s.tmax.z += s.tdelta.z;
+                    steps++;
+                    cell = voxels[BrickOffset(X, Y, Z)];
+                    if (cell)
+                    {
+                        ray.steps += steps;
+                        ray.voxel = cell;
+                        ray.materialIndex = cell;
+                        ray.t = t;
+                        ray.axis = voxelAxis;
+                        return;
+                    }
+                    if (tmax.x < tmax.y)
+                    {
+                        if (tmax.x < tmax.z) { t = tmax.x, voxelAxis = 0; if ((X += s.step.x) / BRICKSIZE != b.X) break; tmax.x += tdelta.x; }
+                        else { t = tmax.z, voxelAxis = 2; if ((Z += s.step.z) / BRICKSIZE != b.Z) break; tmax.z += tdelta.z; }
+                    }
+                    else
+                    {
+                        if (tmax.y < tmax.z) { t = tmax.y, voxelAxis = 1; if ((Y += s.step.y) / BRICKSIZE != b.Y) break; tmax.y += tdelta.y; }
+                        else { t = tmax.z, voxelAxis = 2; if ((Z += s.step.z) / BRICKSIZE != b.Z) break; tmax.z += tdelta.z; }
+                    }
                 }
+                exitAxis = voxelAxis;
+            }
+
+            // Advance to next brick; an empty brick costs a single step. If we walked the voxels,
+            // leave through the same plane as the voxel DDA, so both levels agree at brick corners.
+            if (exitAxis > 2) exitAxis = b.tmax.x < b.tmax.y ? (b.tmax.x < b.tmax.z ? 0 : 2) : (b.tmax.y < b.tmax.z ? 1 : 2);
+            axis = exitAxis;
+            if (exitAxis == 0)
+            {
+                b.t = b.tmax.x;
+                b.X += b.step.x;
+                if (b.X >= GRIDSIZE) { ray.steps += steps; return; }
+                b.tmax.x += b.tdelta.x;
+            }
+            else if (exitAxis == 1)
+            {
+                b.t = b.tmax.y;
+                b.Y += b.step.y;
+                if (b.Y >= GRIDSIZE) { ray.steps += steps; return; }
+                b.tmax.y += b.tdelta.y;
             }
             else
             {
-                if (s.tmax.y < s.tmax.z)
-                {
-                    s.t = s.tmax.y;
-                    s.Y += s.step.y;
-                    axis = 1;
-                    if (s.Y >= WORLDSIZE) return;
-                    s.tmax.y += s.tdelta.y;
-                }
-                else
-                {
-                    s.t = s.tmax.z;
-                    s.Z += s.step.z;
-                    axis = 2;
-                    if (s.Z >= WORLDSIZE) return;
-                    s.tmax.z += s.tdelta.z;
-                }
+                b.t = b.tmax.z;
+                b.Z += b.step.z;
+                if (b.Z >= GRIDSIZE) { ray.steps += steps; return; }
+                b.tmax.z += b.tdelta.z;
             }
         }
-
-        ray.voxel = cell;
-
-        if (ray.voxel != 0)
-        {
-            int idx = s.X + s.Y * WORLDSIZE + s.Z * WORLDSIZE2;
-            ray.materialIndex = grid[idx];
-        }
     }
 
     ray.t = s.t;
     ray.axis = axis;
 }
 
+void Scene::FindNearest8(RayPacket8& packet) const
+{
+	if (backend == BRICKMAP) { Traverse8<false>(packet); return; }
+	// the other backends have no packet walk: trace the lanes one by one, with the same
+	// results Traverse8 writes back (including the nudged origin)
+	for (int lane = 0; lane < 8; lane++)
+	{
+		Ray ray = packet.GetRay(lane);
+		ray.tstart = packet.tstart[lane], ray.voxel = 0, ray.steps = 0;
+		FindNearest(ray);
+		packet.t[lane] = ray.t, packet.voxel[lane] = ray.voxel, packet.axis[lane] = ray.axis, packet.steps[lane] = ray.steps;
+		packet.Ox[lane] = ray.O.x, packet.Oy[lane] = ray.O.y, packet.Oz[lane] = ray.O.z;
+	}
+}
+
+uint Scene::IsOccluded8(RayPacket8& packet) const
+{
+	if (backend == BRICKMAP) return Traverse8<true>(packet);
+	// as in FindNearest8: the other backends test the lanes one by one
+	uint occluded = 0;
+	for (int lane = 0; lane < 8; lane++)
+	{
+		Ray ray(float3(packet.Ox[lane], packet.Oy[lane], packet.Oz[lane]), float3(packet.Dx[lane], packet.Dy[lane], packet.Dz[lane]), packet.t[lane]);
+		if (IsOccluded(ray)) occluded |= 1 << lane;
+		packet.steps[lane] = ray.steps;
+	}
+	return occluded;
+}
+
+#if VOXEL_LAYOUT == LAYOUT_MORTON
+// MortonSpread for the 8 lanes of v
+static inline __m256i MortonSpread8(__m256i v)
+{
+	v = _mm256_and_si256(v, _mm256_set1_epi32(0x3ff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 16)), _mm256_set1_epi32(0x030000ff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 8)), _mm256_set1_epi32(0x0300f00f));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 4)), _mm256_set1_epi32(0x030c30c3));
+	return _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 2)), _mm256_set1_epi32(0x09249249));
+}
+static inline __m256i MortonIndex8(const __m256i x, const __m256i y, const __m256i z)
+{
+	return _mm256_or_si256(_mm256_or_si256(MortonSpread8(x), _mm256_slli_epi32(MortonSpread8(y), 1)), _mm256_slli_epi32(MortonSpread8(z), 2));
+}
+#endif
+
+template <bool anyHit> uint Scene::Traverse8(RayPacket8& packet) const
+{
+	// trace 8 rays in the lanes of AVX2 registers. Every lane skips empty bricks in steps of
+	// BRICKSIZE voxels and walks the voxels of occupied bricks one by one; a lane retires when
+	// it hits a voxel or leaves the world, the packet is done when all lanes retired.
+	// Requires AVX2 (CPUCaps::HW_AVX2); rays that start inside a voxel use FindNearest.
+	// anyHit: shadow rays, as in IsOccluded. A lane also retires at its ray length, a ray that
+	// starts inside a voxel counts as occluded, and the result is the mask of occluded lanes.
+	const __m256 one = _mm256_set1_ps(1), zero = _mm256_setzero_ps(), world = _mm256_set1_ps((float)WORLDSIZE);
+	const __m256 Dx = _mm256_load_ps(packet.Dx), Dy = _mm256_load_ps(packet.Dy), Dz = _mm256_load_ps(packet.Dz);
+	const __m256 eps = _mm256_set1_ps(EPSILON);
+	const __m256 Ox = _mm256_add_ps(_mm256_load_ps(packet.Ox), _mm256_mul_ps(eps, Dx));
+	const __m256 Oy = _mm256_add_ps(_mm256_load_ps(packet.Oy), _mm256_mul_ps(eps, Dy));
+	const __m256 Oz = _mm256_add_ps(_mm256_load_ps(packet.Oz), _mm256_mul_ps(eps, Dz));
+	const __m256 rDx = _mm256_div_ps(one, Dx), rDy = _mm256_div_ps(one, Dy), rDz = _mm256_div_ps(one, Dz);
+	// rays that start outside the world advance to it (slab test, as in intersect_cube)
+	const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(zero, Ox), rDx), tx2 = _mm256_mul_ps(_mm256_sub_ps(one, Ox), rDx);
+	const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(zero, Oy), rDy), ty2 = _mm256_mul_ps(_mm256_sub_ps(one, Oy), rDy);
+	const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(zero, Oz), rDz), tz2 = _mm256_mul_ps(_mm256_sub_ps(one, Oz), rDz);
+	const __m256 ty = _mm256_min_ps(ty1, ty2), tz = _mm256_min_ps(tz1, tz2);
+	__m256 tmin = _mm256_min_ps(tx1, tx2), tmax = _mm256_max_ps(tx1, tx2);
+	tmin = _mm256_max_ps(tmin, ty), tmax = _mm256_min_ps(tmax, _mm256_max_ps(ty1, ty2));
+	tmin = _mm256_max_ps(tmin, tz), tmax = _mm256_min_ps(tmax, _mm256_max_ps(tz1, tz2));
+	const __m256 inWorld = _mm256_and_ps(
+		_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(Ox, zero, _CMP_GE_OQ), _mm256_cmp_ps(Oy, zero, _CMP_GE_OQ)), _mm256_cmp_ps(Oz, zero, _CMP_GE_OQ)),
+		_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(Ox, one, _CMP_LE_OQ), _mm256_cmp_ps(Oy, one, _CMP_LE_OQ)), _mm256_cmp_ps(Oz, one, _CMP_LE_OQ)));
+	__m256i axis = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_setzero_si256(), _mm256_set1_epi32(1), _mm256_castps_si256(_mm256_cmp_ps(tmin, ty, _CMP_EQ_OQ))),
+		_mm256_set1_epi32(2), _mm256_castps_si256(_mm256_cmp_ps(tmin, tz, _CMP_EQ_OQ)));
+	axis = _mm256_andnot_si256(_mm256_castps_si256(inWorld), axis);
+	__m256 t = _mm256_andnot_ps(inWorld, tmin);
+	__m256i active = _mm256_castps_si256(_mm256_or_ps(inWorld, _mm256_cmp_ps(tmax, tmin, _CMP_GE_OQ)));
+	// lanes with nothing to hit before tstart (beam prepass) start there; they can't start inside a
+	// voxel, and have no hit if they leave the world before it
+	const __m256 skip = _mm256_load_ps(packet.tstart), skipped = _mm256_and_ps(_mm256_cmp_ps(skip, zero, _CMP_GT_OQ), _mm256_cmp_ps(skip, t, _CMP_GT_OQ));
+	t = _mm256_blendv_ps(t, skip, skipped);
+	active = _mm256_andnot_si256(_mm256_castps_si256(_mm256_and_ps(skipped, _mm256_cmp_ps(t, tmax, _CMP_GT_OQ))), active);
+	const __m256 atOrigin = _mm256_andnot_ps(skipped, inWorld);
+	const __m256 limit = _mm256_sub_ps(_mm256_load_ps(packet.t), _mm256_set1_ps(EPSILON * 2.0f));
+	if (anyHit) active = _mm256_and_si256(active, _mm256_castps_si256(_mm256_cmp_ps(t, limit, _CMP_LT_OQ)));
+	// from here on: voxel space, where every voxel is 1x1x1
+	const __m256 VOx = _mm256_mul_ps(Ox, world), VOy = _mm256_mul_ps(Oy, world), VOz = _mm256_mul_ps(Oz, world);
+	const __m256 VDx = _mm256_mul_ps(Dx, world), VDy = _mm256_mul_ps(Dy, world), VDz = _mm256_mul_ps(Dz, world);
+	const __m256 invWorld = _mm256_set1_ps(1.0f / WORLDSIZE);
+	const __m256 VrDx = _mm256_mul_ps(rDx, invWorld), VrDy = _mm256_mul_ps(rDy, invWorld), VrDz = _mm256_mul_ps(rDz, invWorld);
+	// 1 for lanes with a non-negative direction, 0 otherwise (1 - Dsign)
+	const __m256i dirPosX = _mm256_cmpeq_epi32(_mm256_srli_epi32(_mm256_castps_si256(Dx), 31), _mm256_setzero_si256());
+	const __m256i dirPosY = _mm256_cmpeq_epi32(_mm256_srli_epi32(_mm256_castps_si256(Dy), 31), _mm256_setzero_si256());
+	const __m256i dirPosZ = _mm256_cmpeq_epi32(_mm256_srli_epi32(_mm256_castps_si256(Dz), 31), _mm256_setzero_si256());
+	const __m256 dirMaskX = _mm256_and_ps(_mm256_castsi256_ps(dirPosX), one);
+	const __m256 dirMaskY = _mm256_and_ps(_mm256_castsi256_ps(dirPosY), one);
+	const __m256 dirMaskZ = _mm256_and_ps(_mm256_castsi256_ps(dirPosZ), one);
+	// first voxel, as in Setup3DDDA
+	const __m256 tstart = _mm256_add_ps(t, _mm256_set1_ps(0.00005f));
+	const __m256i maxP = _mm256_set1_epi32(WORLDSIZE - 1), zeroi = _mm256_setzero_si256();
+	__m256i Px = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(_mm256_add_ps(VOx, _mm256_mul_ps(tstart, VDx))), zeroi), maxP);
+	__m256i Py = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(_mm256_add_ps(VOy, _mm256_mul_ps(tstart, VDy))), zeroi), maxP);
+	__m256i Pz = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(_mm256_add_ps(VOz, _mm256_mul_ps(tstart, VDz))), zeroi), maxP);
+	const __m256i seven = _mm256_set1_epi32(BRICKSIZE - 1), onei = _mm256_set1_epi32(1), outside = _mm256_set1_epi32(~(WORLDSIZE - 1));
+#if VOXEL_LAYOUT == LAYOUT_LINEAR
+	const __m256i gridY = _mm256_set1_epi32(GRIDSIZE), gridZ = _mm256_set1_epi32(GRIDSIZE2);
+	const __m256i brickY = _mm256_set1_epi32(BRICKSIZE), brickZ = _mm256_set1_epi32(BRICKSIZE2);
+#endif
+	const __m256i brickSize = _mm256_set1_epi32(BRICKSIZE3);
+	__m256i voxel = zeroi, hits = zeroi, steps = zeroi, inside = zeroi;
+	bool first = true;
+	while (_mm256_movemask_epi8(active))
+	{
+		steps = _mm256_sub_epi32(steps, active);
+		// fetch the brick and, for occupied bricks, the voxel at P (GridIndex, BrickOffset)
+#if VOXEL_LAYOUT == LAYOUT_MORTON
+		const __m256i cell = MortonIndex8(_mm256_srli_epi32(Px, 3), _mm256_srli_epi32(Py, 3), _mm256_srli_epi32(Pz, 3));
+#else
+		const __m256i cell = _mm256_add_epi32(_mm256_add_epi32(_mm256_srli_epi32(Px, 3),
+			_mm256_mullo_epi32(_mm256_srli_epi32(Py, 3), gridY)), _mm256_mullo_epi32(_mm256_srli_epi32(Pz, 3), gridZ));
+#endif
+		const __m256i b = _mm256_mask_i32gather_epi32(zeroi, (const int*)grid, cell, active, 4);
+		const __m256i occupied = _mm256_andnot_si256(_mm256_cmpeq_epi32(b, zeroi), active);
+#if VOXEL_LAYOUT == LAYOUT_MORTON
+		const __m256i local = MortonIndex8(_mm256_and_si256(Px, seven), _mm256_and_si256(Py, seven), _mm256_and_si256(Pz, seven));
+#else
+		const __m256i local = _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(Px, seven),
+			_mm256_mullo_epi32(_mm256_and_si256(Py, seven), brickY)), _mm256_mullo_epi32(_mm256_and_si256(Pz, seven), brickZ));
+#endif
+		const __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, onei), brickSize), local);
+		__m256i v;
+		if (anyHit)
+		{
+			// shadow rays only test the bit of the voxel, in the 32-bit word of voxelMask that holds it
+			const __m256i word = _mm256_mask_i32gather_epi32(zeroi, (const int*)voxelMask, _mm256_srli_epi32(offset, 5), occupied, 4);
+			v = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(offset, _mm256_set1_epi32(31))), onei);
+		}
+#if VOXEL_PAYLOAD == PAYLOAD_UINT32
+		else v = _mm256_mask_i32gather_epi32(zeroi, (const int*)brick, offset, occupied, 4);
+#else
+		// 8-bit voxels: gather the 32 bits starting at the voxel and keep the low byte
+		else v = _mm256_and_si256(_mm256_mask_i32gather_epi32(zeroi, (const int*)brick, offset, occupied, 1), _mm256_set1_epi32(255));
+#endif
+		__m256i hit = _mm256_andnot_si256(_mm256_cmpeq_epi32(v, zeroi), occupied);
+		if (first && !anyHit)
+		{
+			// lanes that start inside a solid voxel need to find their way out instead
+			inside = _mm256_and_si256(hit, _mm256_castps_si256(atOrigin));
+			hit = _mm256_andnot_si256(inside, hit);
+			active = _mm256_andnot_si256(inside, active);
+			first = false;
+		}
+		voxel = _mm256_blendv_epi8(voxel, v, hit);
+		hits = _mm256_or_si256(hits, hit);
+		active = _mm256_andnot_si256(hit, active);
+		if (!_mm256_movemask_epi8(active)) break;
+		// step to the exit of the current voxel, or of the whole brick if it is empty (see ExitCell)
+		const __m256i size = _mm256_blendv_epi8(_mm256_set1_epi32(BRICKSIZE), onei, occupied);
+		const __m256i last = _mm256_sub_epi32(size, onei);
+		const __m256 sizef = _mm256_cvtepi32_ps(size);
+		const __m256i cx = _mm256_andnot_si256(last, Px), cy = _mm256_andnot_si256(last, Py), cz = _mm256_andnot_si256(last, Pz);
+		const __m256 tpx = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(cx), _mm256_mul_ps(sizef, dirMaskX)), VOx), VrDx);
+		const __m256 tpy = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(cy), _mm256_mul_ps(sizef, dirMaskY)), VOy), VrDy);
+		const __m256 tpz = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(cz), _mm256_mul_ps(sizef, dirMaskZ)), VOz), VrDz);
+		const __m256 exitY = _mm256_cmp_ps(tpy, tpx, _CMP_LT_OQ);
+		__m256 texit = _mm256_blendv_ps(tpx, tpy, exitY);
+		const __m256 exitZ = _mm256_cmp_ps(tpz, texit, _CMP_LT_OQ);
+		texit = _mm256_blendv_ps(texit, tpz, exitZ);
+		const __m256i exitAxis = _mm256_blendv_epi8(_mm256_and_si256(_mm256_castps_si256(exitY), onei), _mm256_set1_epi32(2), _mm256_castps_si256(exitZ));
+		const __m256 tnew = _mm256_max_ps(t, texit);
+		// cross the exit plane, stay inside the cell on the other two axes
+		__m256i nx = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(VOx, _mm256_mul_ps(tnew, VDx))));
+		__m256i ny = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(VOy, _mm256_mul_ps(tnew, VDy))));
+		__m256i nz = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(VOz, _mm256_mul_ps(tnew, VDz))));
+		nx = _mm256_min_epi32(_mm256_max_epi32(nx, cx), _mm256_add_epi32(cx, last));
+		ny = _mm256_min_epi32(_mm256_max_epi32(ny, cy), _mm256_add_epi32(cy, last));
+		nz = _mm256_min_epi32(_mm256_max_epi32(nz, cz), _mm256_add_epi32(cz, last));
+		const __m256i onX = _mm256_cmpeq_epi32(exitAxis, zeroi), onY = _mm256_cmpeq_epi32(exitAxis, onei), onZ = _mm256_cmpeq_epi32(exitAxis, _mm256_set1_epi32(2));
+		nx = _mm256_blendv_epi8(nx, _mm256_blendv_epi8(_mm256_sub_epi32(cx, onei), _mm256_add_epi32(cx, size), dirPosX), onX);
+		ny = _mm256_blendv_epi8(ny, _mm256_blendv_epi8(_mm256_sub_epi32(cy, onei), _mm256_add_epi32(cy, size), dirPosY), onY);
+		nz = _mm256_blendv_epi8(nz, _mm256_blendv_epi8(_mm256_sub_epi32(cz, onei), _mm256_add_epi32(cz, size), dirPosZ), onZ);
+		// only active lanes advance; lanes that left the world retire without a hit
+		Px = _mm256_blendv_epi8(Px, nx, active), Py = _mm256_blendv_epi8(Py, ny, active), Pz = _mm256_blendv_epi8(Pz, nz, active);
+		t = _mm256_blendv_ps(t, tnew, _mm256_castsi256_ps(active));
+		axis = _mm256_blendv_epi8(axis, exitAxis, active);
+		const __m256i out = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(Px, Py), Pz), outside);
+		active = _mm256_and_si256(active, _mm256_cmpeq_epi32(out, zeroi));
+		if (anyHit) active = _mm256_and_si256(active, _mm256_castps_si256(_mm256_cmp_ps(tnew, limit, _CMP_LT_OQ)));
+	}
+	_mm256_store_si256((__m256i*)packet.steps, steps);
+	if (anyHit) return _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+	// write back; missed lanes keep their ray length
+	const __m256 hitf = _mm256_castsi256_ps(hits);
+	_mm256_store_ps(packet.t, _mm256_blendv_ps(_mm256_load_ps(packet.t), t, hitf));
+	_mm256_store_si256((__m256i*)packet.voxel, voxel);
+	_mm256_store_si256((__m256i*)packet.axis, _mm256_blendv_epi8(_mm256_load_si256((const __m256i*)packet.axis), axis, hits));
+	const int insideLanes = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+	for (int lane = 0; lane < 8; lane++) if (insideLanes & (1 << lane))
+	{
+		Ray ray = packet.GetRay(lane);
+		FindNearest(ray);
+		packet.t[lane] = ray.t, packet.voxel[lane] = ray.voxel, packet.axis[lane] = ray.axis, packet.steps[lane] = ray.steps;
+	}
+	_mm256_store_ps(packet.Ox, Ox), _mm256_store_ps(packet.Oy, Oy), _mm256_store_ps(packet.Oz, Oz);
+	return _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+}
+
+// step a grid index or a brick offset by one cell along the coordinate held by 'bits', which
+// is 'stride' entries away in the linear layout
+template <int dir, uint bits, uint stride> static inline uint StepIndex(const uint index)
+{
+#if VOXEL_LAYOUT == LAYOUT_MORTON
+	return MortonStep<dir>(index, bits);
+#else
+	return dir > 0 ? index + stride : index - stride;
+#endif
+}
+
+template <uint octant, bool anyHit> uint Scene::WalkBricks(const Ray& ray, const DDAState& s, float& t, uint& axis, const float tlimit, uint& steps) const
+{
+	// the brick map walk of FindNearest and IsOccluded, for rays whose direction has the signs in
+	// 'octant' (bit 0: D.x < 0, bit 1: D.y, bit 2: D.z). With the signs known at compile time, a
+	// step, a brick exit and a world exit are additions and compares with constants, and the
+	// voxel and brick indices are updated per step instead of recomputed from three coordinates;
+	// the in-brick coordinates are bits of the voxel index in either layout. The axis of a step is still picked by
+	// branches: a branch-free pick puts the tmax compares in the dependency chain of the walk,
+	// which measured slower (voxpopuli_bench --dda). Results match the generic walk exactly,
+	// ties included. anyHit: stop at tlimit, as IsOccluded.
+	constexpr int sx = octant & 1 ? -1 : 1, sy = octant & 2 ? -1 : 1, sz = octant & 4 ? -1 : 1;
+	constexpr uint lastX = sx > 0 ? BRICKSIZE - 1 : 0, lastY = sy > 0 ? BRICKSIZE - 1 : 0, lastZ = sz > 0 ? BRICKSIZE - 1 : 0;
+	constexpr uint lastBX = sx > 0 ? GRIDSIZE - 1 : 0, lastBY = sy > 0 ? GRIDSIZE - 1 : 0, lastBZ = sz > 0 ? GRIDSIZE - 1 : 0;
+	constexpr uint M = BRICKSIZE - 1, SHIFT = BRICKSIZE == 8 ? 3 : BRICKSIZE == 4 ? 2 : 4;
+	static_assert(1 << SHIFT == BRICKSIZE, "WalkBricks: unsupported BRICKSIZE");
+	// bits of the voxel index and the brick index per coordinate; a coordinate is at the edge
+	// of its range if its bits are all set (positive step) or all clear
+#if VOXEL_LAYOUT == LAYOUT_MORTON
+	constexpr uint XB = MORTON_X & (BRICKSIZE3 - 1), YB = MORTON_Y & (BRICKSIZE3 - 1), ZB = MORTON_Z & (BRICKSIZE3 - 1);
+	constexpr uint GX = MORTON_X & (GRIDSIZE3 - 1), GY = MORTON_Y & (GRIDSIZE3 - 1), GZ = MORTON_Z & (GRIDSIZE3 - 1);
+#else
+	constexpr uint XB = M, YB = M << SHIFT, ZB = M << (2 * SHIFT), GX = 0, GY = 0, GZ = 0;
+#endif
+	constexpr uint edgeX = sx > 0 ? XB : 0, edgeY = sy > 0 ? YB : 0, edgeZ = sz > 0 ? ZB : 0;
+	static const float cellSize = 1.0f / WORLDSIZE;
+	DDAState b;
+	b.t = t;
+	SetupBrickDDA(ray, b);
+	uint bx = b.X, by = b.Y, bz = b.Z, brickIdx = GridIndex(bx, by, bz);
+	float btx = b.tmax.x, bty = b.tmax.y, btz = b.tmax.z, bt = b.t;
+	const float3 tdelta = s.tdelta;
+	for (bool first = true;; first = false)
+	{
+		if (anyHit && !(bt < tlimit)) return 0;
+		steps++;
+		uint exitAxis = 3;
+		if (const uint brickId = grid[brickIdx])
+		{
+			// voxel walk, from the start voxel or from the entry point as in EnterBrick
+			uint X = s.X & M, Y = s.Y & M, Z = s.Z & M;
+			if (!first)
+			{
+				const float3 pos = (float)WORLDSIZE * (ray.O + bt * ray.D);
+				X = axis == 0 ? M - lastX : (uint)clamp((int)pos.x - (int)(bx * BRICKSIZE), 0, (int)M);
+				Y = axis == 1 ? M - lastY : (uint)clamp((int)pos.y - (int)(by * BRICKSIZE), 0, (int)M);
+				Z = axis == 2 ? M - lastZ : (uint)clamp((int)pos.z - (int)(bz * BRICKSIZE), 0, (int)M);
+			}
+			// any hit needs only the bits of the voxels, read a byte at a time: a 64-bit shift by
+			// a variable amount measured slower
+			const Voxel* voxels = brick + (size_t)(brickId - 1) * BRICKSIZE3;
+			const uchar* bits = (const uchar*)(voxelMask + (size_t)(brickId - 1) * MASKWORDS);
+			uint v = BrickOffset(X, Y, Z);
+			float tx = ((float)(bx * BRICKSIZE + X + (sx > 0)) * cellSize - ray.O.x) * ray.rD.x;
+			float ty = ((float)(by * BRICKSIZE + Y + (sy > 0)) * cellSize - ray.O.y) * ray.rD.y;
+			float tz = ((float)(bz * BRICKSIZE + Z + (sz > 0)) * cellSize - ray.O.z) * ray.rD.z;
+			float tv = bt;
+			uint voxelAxis = axis;
+			while (true)
+			{
+				steps++;
+				if (const uint cell = anyHit ? (uint)(bits[v >> 3] >> (v & 7)) & 1 : voxels[v]) { t = tv, axis = voxelAxis; return cell; }
+				if (tx < ty)
+				{
+					if (tx < tz) { tv = tx, voxelAxis = 0; if ((v & XB) == edgeX) break; v = StepIndex<sx, XB, 1>(v), tx += tdelta.x; }
+					else { tv = tz, voxelAxis = 2; if ((v & ZB) == edgeZ) break; v = StepIndex<sz, ZB, BRICKSIZE2>(v), tz += tdelta.z; }
+				}
+				else
+				{
+					if (ty < tz) { tv = ty, voxelAxis = 1; if ((v & YB) == edgeY) break; v = StepIndex<sy, YB, BRICKSIZE>(v), ty += tdelta.y; }
+					else { tv = tz, voxelAxis = 2; if ((v & ZB) == edgeZ) break; v = StepIndex<sz, ZB, BRICKSIZE2>(v), tz += tdelta.z; }
+				}
+				if (anyHit && tv >= tlimit) return 0;
+			}
+			exitAxis = voxelAxis;
+		}
+		// next brick, through the plane the voxel walk left by, if there was one
+		if (exitAxis > 2) exitAxis = btx < bty ? (btx < btz ? 0 : 2) : (bty < btz ? 1 : 2);
+		axis = exitAxis;
+		if (exitAxis == 0) { if (bx == lastBX) return 0; bt = btx, bx += sx, brickIdx = StepIndex<sx, GX, 1>(brickIdx), btx += b.tdelta.x; }
+		else if (exitAxis == 1) { if (by == lastBY) return 0; bt = bty, by += sy, brickIdx = StepIndex<sy, GY, GRIDSIZE>(brickIdx), bty += b.tdelta.y; }
+		else { if (bz == lastBZ) return 0; bt = btz, bz += sz, brickIdx = StepIndex<sz, GZ, GRIDSIZE2>(brickIdx), btz += b.tdelta.z; }
+	}
+}
+
+uint Scene::WalkBricks(const Ray& ray, const DDAState& s, float& t, uint& axis, const float tlimit, uint& steps, const bool anyHit) const
+{
+	// dispatch on the direction octant, once per ray
+	using Walk = uint (Scene::*)(const Ray&, const DDAState&, float&, uint&, const float, uint&) const;
+	static constexpr Walk walk[2][8] = {
+		{ &Scene::WalkBricks<0, false>, &Scene::WalkBricks<1, false>, &Scene::WalkBricks<2, false>, &Scene::WalkBricks<3, false>,
+		  &Scene::WalkBricks<4, false>, &Scene::WalkBricks<5, false>, &Scene::WalkBricks<6, false>, &Scene::WalkBricks<7, false> },
+		{ &Scene::WalkBricks<0, true>, &Scene::WalkBricks<1, true>, &Scene::WalkBricks<2, true>, &Scene::WalkBricks<3, true>,
+		  &Scene::WalkBricks<4, true>, &Scene::WalkBricks<5, true>, &Scene::WalkBricks<6, true>, &Scene::WalkBricks<7, true> } };
+	const uint octant = (uint)ray.Dsign.x + (uint)ray.Dsign.y * 2 + (uint)ray.Dsign.z * 4;
+	return (this->*walk[anyHit][octant])(ray, s, t, axis, tlimit, steps);
+}
+
 bool Scene::IsOccluded(Ray& ray) const
 {
 	// nudge origin
 	ray.O += EPSILON * ray.D;
 	ray.t -= EPSILON * 2.0f;
-	// setup Amanatides & Woo grid traversal
+	// setup Amanatides & Woo grid traversal, at brick granularity
 	DDAState s;
 	if (!Setup3DDDA(ray, s)) return false;
+	if (backend != BRICKMAP)
+	{
+		float t = s.t;
+		uint axis = ray.axis;
+		const int3 P = make_int3(s.X, s.Y, s.Z);
+		if (backend == TREE64) return tree.Traverse(ray, P, t, axis, ray.t, ray.steps) != 0;
+		return TraversePyramid(ray, P, t, axis, ray.t, ray.steps) != 0;
+	}
+	if (octantKernels)
+	{
+		float t = s.t;
+		uint axis = ray.axis, steps = 0;
+		const uint cell = WalkBricks(ray, s, t, axis, ray.t, steps, true);
+		ray.steps += steps;
+		return cell != 0;
+	}
+	DDAState b;
+	b.t = s.t;
+	SetupBrickDDA(ray, b);
+	static const float cellSize = 1.0f / WORLDSIZE;
 	// start stepping
-	while (s.t < ray.t)
+	uint steps = 0, axis = 3;
+	for (bool first = true; b.t < ray.t; first = false)
 	{
-		const uint cell = grid[s.X + s.Y * WORLDSIZE + s.Z * WORLDSIZE2];
-		if (cell) /* we hit a solid voxel */ return s.t < ray.t;
-		if (s.tmax.x < s.tmax.y)
+		steps++;
+		uint exitAxis = 3;
+		const uint brickIdx = grid[GridIndex(b.X, b.Y, b.Z)];
+		if (brickIdx)
 		{
-			if (s.tmax.x < s.tmax.z) { if ((s.X += s.step.x) >= WORLDSIZE) return false; s.t = s.tmax.x, s.tmax.x += s.tdelta.x; }
-			else { if ((s.Z += s.step.z) >= WORLDSIZE) return false; s.t = s.tmax.z, s.tmax.z += s.tdelta.z; }
-		}
-		else
-		{
-			if (s.tmax.y < s.tmax.z) { if ((s.Y += s.step.y) >= WORLDSIZE) return false; s.t = s.tmax.y, s.tmax.y += s.tdelta.y; }
-			else { if ((s.Z += s.step.z) >= WORLDSIZE) return false; s.t = s.tmax.z, s.tmax.z += s.tdelta.z; }
+			// walk the voxels of this brick; only their bits, the payload does not matter here
+			const uchar* bits = (const uchar*)(voxelMask + (size_t)(brickIdx - 1) * MASKWORDS);
+			uint X = s.X, Y = s.Y, Z = s.Z;
+			if (!first) EnterBrick(ray, b, axis, X, Y, Z);
+			float3 tmax = ((float3((float)X, (float)Y, (float)Z) + 1.0f - ray.Dsign) * cellSize - ray.O) * ray.rD;
+			float t = b.t;
+			while (true)
+			{
+				steps++;
+				const uint offset = BrickOffset(X, Y, Z);
+				if ((bits[offset >> 3] >> (offset & 7)) & 1) /* we hit a solid voxel */ { ray.steps += steps; return true; }
+				if (tmax.x < tmax.y)
+				{
+					if (tmax.x < tmax.z) { t = tmax.x, exitAxis = 0; if ((X += s.step.x) / BRICKSIZE != b.X) break; tmax.x += s.tdelta.x; }
+					else { t = tmax.z, exitAxis = 2; if ((Z += s.step.z) / BRICKSIZE != b.Z) break; tmax.z += s.tdelta.z; }
+				}
+				else
+				{
+					if (tmax.y < tmax.z) { t = tmax.y, exitAxis = 1; if ((Y += s.step.y) / BRICKSIZE != b.Y) break; tmax.y += s.tdelta.y; }
+					else { t = tmax.z, exitAxis = 2; if ((Z += s.step.z) / BRICKSIZE != b.Z) break; tmax.z += s.tdelta.z; }
+				}
+				if (t >= ray.t) { ray.steps += steps; return false; }
+			}
 		}
+		// leave the brick through the same plane as the voxel walk, if there was one
+		if (exitAxis > 2) exitAxis = b.tmax.x < b.tmax.y ? (b.tmax.x < b.tmax.z ? 0 : 2) : (b.tmax.y < b.tmax.z ? 1 : 2);
+		axis = exitAxis;
+		if (exitAxis == 0) { if ((b.X += b.step.x) >= GRIDSIZE) break; b.t = b.tmax.x, b.tmax.x += b.tdelta.x; }
+		else if (exitAxis == 1) { if ((b.Y += b.step.y) >= GRIDSIZE) break; b.t = b.tmax.y, b.tmax.y += b.tdelta.y; }
+		else { if ((b.Z += b.step.z) >= GRIDSIZE) break; b.t = b.tmax.z, b.tmax.z += b.tdelta.z; }
 	}
+	ray.steps += steps;
 	return false;
-}
\ No newline at end of file
+}
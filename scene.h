@@ -1,11 +1,37 @@
 #pragma once
 
 // high level settings
-#define WORLDSIZE 128 // power of 2. Warning: max 512 for a 512x512x512x4 bytes = 512MB world!
+#define WORLDSIZE 128 // power of 2. Memory scales with occupied bricks only, so 1024 or 2048 is fine.
+#define BRICKSIZE 8 // voxels per brick side; power of 2
 
 // low-level / derived
 #define WORLDSIZE2	(WORLDSIZE*WORLDSIZE)
 #define WORLDSIZE3	(WORLDSIZE*WORLDSIZE*WORLDSIZE)
+#define BRICKSIZE2	(BRICKSIZE*BRICKSIZE)
+#define BRICKSIZE3	(BRICKSIZE*BRICKSIZE*BRICKSIZE)
+#define GRIDSIZE	(WORLDSIZE/BRICKSIZE)
+#define GRIDSIZE2	(GRIDSIZE*GRIDSIZE)
+#define GRIDSIZE3	(GRIDSIZE*GRIDSIZE*GRIDSIZE)
+
+// voxel addressing (see GridIndex and BrickOffset): the brick map and the voxels of a brick in
+// scanline order, x fastest, or in Morton (Z-) order, where every aligned 2x2x2, 4x4x4, ..
+// block is contiguous, so that a step along y or z lands closer in memory. Set with the CMake
+// option VOXPOPULI_VOXEL_LAYOUT; world files only map in the layout they were saved with.
+#define LAYOUT_LINEAR 0
+#define LAYOUT_MORTON 1
+#ifndef VOXEL_LAYOUT
+#define VOXEL_LAYOUT LAYOUT_LINEAR
+#endif
+
+// voxel payload (see Voxel): an 8-bit material index, which is all the renderer stores, or, opt
+// in for scenes that keep more per voxel, such as a color, 32 bits. Set with the CMake option
+// VOXPOPULI_VOXEL_PAYLOAD. Either way every brick also has a bitmap of its solid voxels
+// (Scene::voxelMask), and shadow rays read only that.
+#define PAYLOAD_MATERIAL8 0
+#define PAYLOAD_UINT32 1
+#ifndef VOXEL_PAYLOAD
+#define VOXEL_PAYLOAD PAYLOAD_MATERIAL8
+#endif
 
 // epsilon
 #define EPSILON		0.00001f
@@ -34,6 +60,68 @@ struct Material;
 
 namespace Tmpl8 {
 
+	// advance a ray in voxel space (O, D, rD, dirMask = 1 - Dsign) to the exit of the aligned cell of
+	// 'size' voxels that contains voxel P. P becomes the first voxel beyond the exit plane, 'axis' that
+	// plane's axis. Used by the traversals that skip empty space in variable-sized steps.
+	inline void ExitCell(const float3& O, const float3& D, const float3& rD, const float3& dirMask, const int size, int3& P, float& t, uint& axis)
+	{
+		const int3 cellMin = make_int3(P.x & ~(size - 1), P.y & ~(size - 1), P.z & ~(size - 1));
+		const float3 tplane = ((float3(cellMin) + (float)size * dirMask) - O) * rD;
+		uint exitAxis = 0;
+		float texit = tplane.x;
+		if (tplane.y < texit) texit = tplane.y, exitAxis = 1;
+		if (tplane.z < texit) texit = tplane.z, exitAxis = 2;
+		t = max(t, texit), axis = exitAxis;
+		// cross the exit plane, stay inside the cell on the other two axes
+		const float3 pos = O + t * D;
+		P.x = clamp((int)floorf(pos.x), cellMin.x, cellMin.x + size - 1);
+		P.y = clamp((int)floorf(pos.y), cellMin.y, cellMin.y + size - 1);
+		P.z = clamp((int)floorf(pos.z), cellMin.z, cellMin.z + size - 1);
+		P[exitAxis] = dirMask[exitAxis] > 0 ? cellMin[exitAxis] + size : cellMin[exitAxis] - 1;
+	}
+
+#if VOXEL_PAYLOAD == PAYLOAD_UINT32
+	typedef uint Voxel;
+#else
+	typedef uchar Voxel;	// index in Scene::materials, which has MAX_MATERIALS entries
+#endif
+	static constexpr uint MASKWORDS = BRICKSIZE3 / 64; // 64-bit words of Scene::voxelMask per brick
+
+	// spread the low 10 bits of v over every third bit: the x part of a Morton index
+	inline uint MortonSpread(uint v)
+	{
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		return (v | (v << 2)) & 0x09249249;
+	}
+	// step one coordinate of a Morton index by +1 or -1; 'bits' are the bits of that coordinate
+	template <int dir> inline uint MortonStep(const uint index, const uint bits)
+	{
+		return (dir > 0 ? ((index | ~bits) + 1) & bits : ((index & bits) - 1) & bits) | (index & ~bits);
+	}
+	static constexpr uint MORTON_X = 0x49249249, MORTON_Y = MORTON_X << 1, MORTON_Z = MORTON_X << 2;
+	// index of brick x, y, z in Scene::grid
+	inline uint GridIndex(const uint x, const uint y, const uint z)
+	{
+	#if VOXEL_LAYOUT == LAYOUT_MORTON
+		return MortonSpread(x) | (MortonSpread(y) << 1) | (MortonSpread(z) << 2);
+	#else
+		return x + y * GRIDSIZE + z * GRIDSIZE2;
+	#endif
+	}
+	// offset of voxel x, y, z (world coordinates) in the BRICKSIZE3 block of its brick
+	inline uint BrickOffset(const uint x, const uint y, const uint z)
+	{
+		const uint bx = x & (BRICKSIZE - 1), by = y & (BRICKSIZE - 1), bz = z & (BRICKSIZE - 1);
+	#if VOXEL_LAYOUT == LAYOUT_MORTON
+		return MortonSpread(bx) | (MortonSpread(by) << 1) | (MortonSpread(bz) << 2);
+	#else
+		return bx + by * BRICKSIZE + bz * BRICKSIZE2;
+	#endif
+	}
+
 	class Scene
 	{
 	public:
@@ -45,15 +133,89 @@ namespace Tmpl8 {
 			float3 tdelta;
 			float3 tmax;
 		};
-		Scene();
+		// traversal backends, switchable at runtime for A/B comparisons. The brick map walk skips
+		// empty space one brick (level 3 of the occupancy pyramid) at a time; PYRAMID takes the
+		// largest empty block of any level instead. That needs 2-3x fewer steps per ray, but each
+		// step costs more than the gain (voxpopuli_bench --backend pyramid), so it is not the default.
+		enum Backend { BRICKMAP = 0, TREE64, PYRAMID, BACKEND_COUNT };
+		static constexpr int MAXLEVELS = 16;
+		static constexpr uint MAX_MATERIALS = 256; // MaterialID is 8-bit; palette entries follow MAT_COUNT
+		Scene(const char* file = nullptr); // maps 'file' if it holds a valid world, else builds the default scene
+		void Commit();
+		void Clear();
 		void FindNearest(Ray& ray) const;
+		void FindNearest8(RayPacket8& packet) const; // AVX2 for the brick map, lane by lane for the other backends
 		bool IsOccluded(Ray& ray) const;
-		void Set(const uint x, const uint y, const uint z, const uint v);
-		unsigned int* grid; // voxel payload is 'unsigned int', interpretation of the bits is free!
-		std::array<Material, MAT_COUNT> materials;
+		uint IsOccluded8(RayPacket8& packet) const; // as FindNearest8; returns the mask of occluded lanes
+		// distance along normalized D up to which the cone around O, D, with a radius of 'slope'
+		// times the distance, holds no solid voxel; conservative, from the occupancy pyramid
+		float ConeFreeDistance(const float3& O, const float3& D, const float slope) const;
+		void Set(const uint x, const uint y, const uint z, const uint v); // v is stored as a Voxel
+		// gzip voxel models (assets/*.bin): three ints for the size, then one 0xRRGGBB value per
+		// voxel, x fastest; 0 is empty. Colors become materials via the palette. Some models were
+		// written with a fourth, padding int after the size (sizeof(int3)).
+		struct ModelPlacement
+		{
+			string file;
+			int3 position;		// world voxel that the model's first voxel lands on
+			float scale = 1;	// world voxels per model voxel
+		};
+		// reads the size of model 'file', opened as 'f', and leaves 'f' at its first voxel
+		static bool ReadModelHeader(const string& file, gzFile f, int3& size);
+		bool LoadModel(const ModelPlacement& model);
+		int LoadModels(const std::vector<ModelPlacement>& models); // in parallel; returns the number loaded
+		uint MaterialForColor(const uint rgb);
+		// native world files: a header, the brick map, brick masks, occupancy levels, the material
+		// table and the palette, each 64-byte aligned. Map uses the file in place: the traversal
+		// reads the mapped pages, which load on first touch; Set copies a page before changing it.
+		bool Save(const char* file) const;
+		bool Map(const char* file);
+		inline uint Get(const uint x, const uint y, const uint z) const
+		{
+			const uint b = grid[GridIndex(x / BRICKSIZE, y / BRICKSIZE, z / BRICKSIZE)];
+			if (!b) return 0;
+			return brick[(size_t)(b - 1) * BRICKSIZE3 + BrickOffset(x, y, z)];
+		}
+		size_t MemoryUsage() const;
+		// two-level brick map: 'grid' holds one entry per brick; 0 means empty, anything else
+		// is 1 + the index of a BRICKSIZE3 block in 'brick'. Empty bricks take no memory.
+		// Entries and voxels are addressed with GridIndex and BrickOffset.
+		uint* grid = nullptr;
+		Voxel* brick = nullptr; // voxel payload, see VOXEL_PAYLOAD; 0 is empty
+		uint64_t* voxelMask = nullptr; // per brick MASKWORDS words, one bit per solid voxel, indexed like 'brick'
+		ushort* brickVoxels = nullptr; // solid voxel count per brick, to release bricks that become empty
+		uint brickCount = 0, brickCapacity = 0;
+		std::vector<uint> freeBricks;
+		std::array<Material, MAX_MATERIALS> materials;
+		uint materialCount = MAT_COUNT; // built-in materials, then palette entries
+		std::unordered_map<uint, uint> palette; // 0xRRGGBB to material index
+		// occupancy pyramid: level L has one bit per (2^L)^3 block. Level 0 is voxelMask, levels 1
+		// and 2 come from a 64-bit mask per brick (one bit per 2x2x2 block), level 3 is the brick map
+		// itself and the coarser levels are bitfields. Set keeps all levels up to date.
+		uint64_t* brickMask = nullptr;
+		std::vector<uint64_t> occupancy[MAXLEVELS];
+		int topLevel; // coarsest level; its cells are WORLDSIZE / 2 voxels wide
+		int backend = BRICKMAP;
+		bool octantKernels = true; // brick map: scalar rays use the walk specialized on their direction octant (WalkBricks)
+		Tree64 tree; // built from the brick map by Commit when the 64-tree backend is active
+		uint version = 0, treeVersion = ~0u; // 'version' is bumped by every Set
+		uchar* mapping = nullptr; // world file mapped by Map, if any
+		size_t mappingSize = 0;
 
 	private:
 		bool Setup3DDDA(Ray& ray, DDAState& state) const;
+		void SetupBrickDDA(const Ray& ray, DDAState& state) const;
+		void EnterBrick(const Ray& ray, const DDAState& b, const uint axis, uint& X, uint& Y, uint& Z) const;
+		uint AllocateBrick();
+		bool InMapping(const void* p) const { return mapping && (const uchar*)p >= mapping && (const uchar*)p < mapping + mappingSize; }
+		void ReleaseStorage();
+		bool StreamModel(const ModelPlacement& model, std::mutex& lock);
+		bool Occupied(const int level, const int3& P) const;
+		void ClearOccupancy(const uint x, const uint y, const uint z);
+		uint TraversePyramid(const Ray& ray, int3 P, float& t, uint& axis, const float tlimit, uint& steps) const;
+		template <bool anyHit> uint Traverse8(RayPacket8& packet) const;
+		template <uint octant, bool anyHit> uint WalkBricks(const Ray& ray, const DDAState& s, float& t, uint& axis, const float tlimit, uint& steps) const;
+		uint WalkBricks(const Ray& ray, const DDAState& s, float& t, uint& axis, const float tlimit, uint& steps, const bool anyHit) const;
 	};
 
 }
@@ -0,0 +1,297 @@
+#include "template.h"
+
+#include "Core/ShadingPoint.h"
+
+constexpr float DEG2RAD = 3.14159265359f / 180.0f;
+
+// point 'i' of the two-dimensional Sobol sequence; every aligned run of 4^k points has
+// exactly one point in each cell of a 2^k x 2^k grid
+static float2 Sobol2(uint i)
+{
+    uint x = 0, y = 0;
+    for (uint v = 1u << 31, w = 1u << 31; i; i >>= 1, v >>= 1, w ^= w >> 1) if (i & 1) x ^= v, y ^= w;
+    return float2(x * (1.0f / 4294967296.0f), y * (1.0f / 4294967296.0f));
+}
+
+int LightSet::AddPoint(const float3& position, const float3& color)
+{
+    point.x.push_back(position.x), point.y.push_back(position.y), point.z.push_back(position.z);
+    point.color.push_back(color);
+    point.enabled.push_back(1);
+    return point.Count() - 1;
+}
+
+int LightSet::AddDirectional(const float3& direction, const float3& color)
+{
+    directional.dx.push_back(direction.x), directional.dy.push_back(direction.y), directional.dz.push_back(direction.z);
+    directional.color.push_back(color);
+    directional.enabled.push_back(1);
+    directional.cache.emplace_back();
+    return directional.Count() - 1;
+}
+
+int LightSet::AddSpot(const float3& position, const float3& direction, const float3& color, const float range)
+{
+    const float3 D = normalize(direction);
+    spot.x.push_back(position.x), spot.y.push_back(position.y), spot.z.push_back(position.z);
+    spot.dx.push_back(D.x), spot.dy.push_back(D.y), spot.dz.push_back(D.z);
+    spot.color.push_back(color);
+    spot.range.push_back(range);
+    spot.angleDeg.push_back(10.0f);
+    spot.edgeRoughness.push_back(0.0f);
+    spot.cosOuter.push_back(0), spot.cosInner.push_back(0);
+    spot.enabled.push_back(1);
+    UpdateSpot(spot.Count() - 1);
+    return spot.Count() - 1;
+}
+
+int LightSet::AddArea(const float3& corner, const float3& edge1, const float3& edge2, const float3& color, const int u, const int v)
+{
+    area.corner.push_back(corner), area.edge1.push_back(edge1), area.edge2.push_back(edge2);
+    // normal is perpendicular to the area light surface
+    area.normal.push_back(normalize(cross(edge1, edge2)));
+    area.color.push_back(color);
+    area.intensity.push_back(1.0f);
+    area.uSteps.push_back(u), area.vSteps.push_back(v);
+    area.enabled.push_back(1);
+    return area.Count() - 1;
+}
+
+void LightSet::UpdateSpot(const int i)
+{
+    // spotlight cone with proportional roughness
+    const float outerAngle = spot.angleDeg[i];
+    const float innerAngle = spot.angleDeg[i] * (1.0f - spot.edgeRoughness[i]);
+    spot.cosOuter[i] = cosf(outerAngle * 0.5f * DEG2RAD);
+    spot.cosInner[i] = cosf(innerAngle * 0.5f * DEG2RAD);
+}
+
+// point light: inverse square falloff
+bool LightSet::ConnectPoint(const int i, const ShadingPoint& sp, ShadowRay& r) const
+{
+    const float3 L = float3(point.x[i], point.y[i], point.z[i]) - sp.position;
+    const float distance = length(L);
+    const float3 Ldir = normalize(L);
+    const float ndotl = max(0.0f, dot(sp.normal, Ldir));
+    if (ndotl <= 0) return false;
+    r.O = sp.position, r.D = Ldir, r.t = distance;
+    const float attenuation = 1.0f / (distance * distance);
+    r.contribution = point.color[i] * sp.albedo * ndotl * attenuation;
+    return true;
+}
+
+// directional light; the shadow ray starts half a voxel above the surface
+bool LightSet::ConnectDirectional(const int i, const ShadingPoint& sp, const Scene& scene, ShadowRay& r) const
+{
+    const float voxelSize = 1.0f / WORLDSIZE;
+    const float3 Ldir = normalize(-float3(directional.dx[i], directional.dy[i], directional.dz[i]));
+    const float ndotl = max(0.0f, dot(sp.normal, Ldir));
+    if (ndotl <= 0) return false;
+    r.O = sp.position + sp.normal * (voxelSize * 0.5f), r.D = Ldir, r.t = 1e34f;
+    r.contribution = directional.color[i] * sp.albedo * ndotl;
+    // with an up-to-date cache, the visibility of the face replaces the shadow ray
+    const ShadowCache& cache = directional.cache[i];
+    if (useShadowCache && cache.version == scene.version)
+    {
+        if (!cache.Visible(scene, sp.position, sp.normal)) return false;
+        r.t = 0;
+    }
+    return true;
+}
+
+// spot light: range and cone are tested before the shadow ray
+bool LightSet::ConnectSpot(const int i, const ShadingPoint& sp, ShadowRay& r) const
+{
+    const float EPS = 0.05f;
+    const float3 toPoint = sp.position - float3(spot.x[i], spot.y[i], spot.z[i]);
+    const float distance = length(toPoint);
+    if (distance > spot.range[i]) return false;
+    const float3 L = normalize(toPoint);
+    const float spotFactor = dot(float3(spot.dx[i], spot.dy[i], spot.dz[i]), L);
+    if (spotFactor < spot.cosOuter[i]) return false;
+    const float ndotl = max(0.0f, dot(sp.normal, -L)); // -L: L points from the light to the surface
+    if (ndotl <= 0) return false;
+    r.O = sp.position + sp.normal * EPS, r.D = -L, r.t = 1e34f;
+    const float attenuation = 1.0f - distance / spot.range[i];
+    const float spotIntensity = clamp((spotFactor - spot.cosOuter[i]) / (spot.cosInner[i] - spot.cosOuter[i]), 0.0f, 1.0f);
+    r.contribution = spot.color[i] * sp.albedo * ndotl * attenuation * spotIntensity;
+    return true;
+}
+
+// area light, for the point at (u, v) in [0,1]^2 on the rectangle
+bool LightSet::ConnectArea(const int i, const ShadingPoint& sp, const float u, const float v, ShadowRay& r) const
+{
+    const float EPS = 0.05f;
+    const float3 lightPos = area.corner[i] + area.edge1[i] * u + area.edge2[i] * v;
+    const float3 L = lightPos - sp.position;
+    const float dist = length(L);
+    const float3 Ldir = normalize(L);
+    // one-sided emission
+    if (dot(area.normal[i], -Ldir) <= 0.0f) return false;
+    const float ndotl = max(0.0f, dot(sp.normal, Ldir));
+    if (ndotl <= 0) return false;
+    r.O = sp.position + sp.normal * EPS, r.D = Ldir, r.t = dist - EPS;
+    const float attenuation = 1.0f / (dist * dist);
+    r.contribution = (area.color[i] * area.intensity[i]) * sp.albedo * ndotl * attenuation;
+    return true;
+}
+
+// the contribution of a shadow ray, if nothing blocks it
+float3 LightSet::Trace(const ShadowRay& r, const Scene& scene)
+{
+    if (r.t == 0) return r.contribution;
+    Ray shadowRay(r.O, r.D, r.t);
+    return scene.IsOccluded(shadowRay) ? float3(0) : r.contribution;
+}
+
+// progressive area light sample 'index' for this pixel: the Sobol sequence, shifted by a
+// random offset per pixel and light (Cranley-Patterson rotation) so that pixels don't correlate
+float2 LightSet::AreaSample(const int i, const ShadingPoint& sp, const uint index) const
+{
+    const uint h = WangHash(sp.pixel * 7919 + i + 1);
+    const float2 offset((h & 0xffff) * (1.0f / 65536.0f), (h >> 16) * (1.0f / 65536.0f));
+    const float2 s = Sobol2(index) + offset;
+    return float2(s.x >= 1 ? s.x - 1 : s.x, s.y >= 1 ? s.y - 1 : s.y);
+}
+
+// area light: Riemann sum over a uSteps x vSteps grid of points on the rectangle, or, in
+// progressive mode, the average over this frame's areaSamples points of the sequence
+float3 LightSet::EvaluateArea(const int i, const ShadingPoint& sp, const Scene& scene) const
+{
+    ShadowRay r;
+    if (areaSamples > 0)
+    {
+        float3 sum(0.0f);
+        for (int s = 0; s < areaSamples; s++)
+        {
+            const float2 uv = AreaSample(i, sp, frame * areaSamples + s);
+            if (ConnectArea(i, sp, uv.x, uv.y, r)) sum += Trace(r, scene);
+        }
+        return sum / float(areaSamples);
+    }
+    const int uSteps = area.uSteps[i], vSteps = area.vSteps[i];
+    float3 sum(0.0f);
+    for (int v = 0; v < vSteps; ++v) for (int u = 0; u < uSteps; ++u)
+        if (ConnectArea(i, sp, (u + 0.5f) / uSteps, (v + 0.5f) / vSteps, r)) sum += Trace(r, scene);
+    return sum / float(uSteps * vSteps);
+}
+
+void LightSet::Illuminate(const ShadingPoint& sp, const Scene& scene, const float3& weight, float3& result) const
+{
+    ShadowRay r;
+    for (int i = 0; i < point.Count(); i++) if (point.enabled[i] && ConnectPoint(i, sp, r)) result += weight * Trace(r, scene);
+    for (int i = 0; i < directional.Count(); i++) if (directional.enabled[i] && ConnectDirectional(i, sp, scene, r)) result += weight * Trace(r, scene);
+    for (int i = 0; i < spot.Count(); i++) if (spot.enabled[i] && ConnectSpot(i, sp, r)) result += weight * Trace(r, scene);
+    for (int i = 0; i < area.Count(); i++) if (area.enabled[i]) result += weight * EvaluateArea(i, sp, scene);
+}
+
+void LightSet::UpdateDistribution()
+{
+    // power estimate: luminance of the light arriving head-on at unit distance
+    auto power = [](const float3& c) { return max(1e-6f, 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z); };
+    cdf.clear(), cdfLight.clear();
+    float sum = 0;
+    auto add = [&](const uint type, const int i, const float p) { cdf.push_back(sum += p), cdfLight.push_back(type << 30 | i); };
+    for (int i = 0; i < point.Count(); i++) if (point.enabled[i]) add(POINT, i, power(point.color[i]));
+    for (int i = 0; i < directional.Count(); i++) if (directional.enabled[i]) add(DIRECTIONAL, i, power(directional.color[i]));
+    for (int i = 0; i < spot.Count(); i++) if (spot.enabled[i]) add(SPOT, i, power(spot.color[i]));
+    for (int i = 0; i < area.Count(); i++) if (area.enabled[i]) add(AREA, i, power(area.color[i] * area.intensity[i]));
+}
+
+// pick a light in proportion to its power; returns the entry in the distribution
+int LightSet::Pick(float& pdf) const
+{
+    const float total = cdf.back();
+    const int entry = cdf.size() == 1 ? 0 : min((int)(std::upper_bound(cdf.begin(), cdf.end(), RandomFloat() * total) - cdf.begin()), (int)cdf.size() - 1);
+    pdf = (cdf[entry] - (entry ? cdf[entry - 1] : 0)) / total;
+    return entry;
+}
+
+// shadow ray towards the light of distribution entry 'entry'; an area light gets one point,
+// 'index' of the pixel's sequence in progressive mode, else a random one
+bool LightSet::ConnectEntry(const int entry, const ShadingPoint& sp, const Scene& scene, const uint index, ShadowRay& r) const
+{
+    const int i = cdfLight[entry] & 0x3fffffff;
+    switch (cdfLight[entry] >> 30)
+    {
+    case POINT: return ConnectPoint(i, sp, r);
+    case DIRECTIONAL: return ConnectDirectional(i, sp, scene, r);
+    case SPOT: return ConnectSpot(i, sp, r);
+    default:
+        const float2 uv = areaSamples > 0 ? AreaSample(i, sp, index) : float2(RandomFloat(), RandomFloat());
+        return ConnectArea(i, sp, uv.x, uv.y, r);
+    }
+}
+
+void LightSet::Sample(const ShadingPoint& sp, const Scene& scene, const float3& weight, float3& result, const int count) const
+{
+    if (cdf.empty()) return;
+    ShadowRay r;
+    for (int s = 0; s < count; s++)
+    {
+        float pdf;
+        const int entry = Pick(pdf);
+        if (ConnectEntry(entry, sp, scene, frame * count + s, r)) result += weight * Trace(r, scene) * (1.0f / (pdf * count));
+    }
+}
+
+void LightSet::Connect(const ShadingPoint& sp, const Scene& scene, const int count, std::vector<ShadowRay>& rays) const
+{
+    ShadowRay r;
+    auto add = [&](const uint light, const float scale, const int samples)
+    {
+        r.light = light, r.scale = scale, r.samples = samples;
+        rays.push_back(r);
+    };
+    if (count == 0)
+    {
+        // every light, as in Illuminate
+        for (int i = 0; i < point.Count(); i++) if (point.enabled[i] && ConnectPoint(i, sp, r)) add(POINT << 30 | i, 1, 0);
+        for (int i = 0; i < directional.Count(); i++) if (directional.enabled[i] && ConnectDirectional(i, sp, scene, r)) add(DIRECTIONAL << 30 | i, 1, 0);
+        for (int i = 0; i < spot.Count(); i++) if (spot.enabled[i] && ConnectSpot(i, sp, r)) add(SPOT << 30 | i, 1, 0);
+        for (int i = 0; i < area.Count(); i++) if (area.enabled[i])
+        {
+            if (areaSamples > 0) for (int s = 0; s < areaSamples; s++)
+            {
+                const float2 uv = AreaSample(i, sp, frame * areaSamples + s);
+                if (ConnectArea(i, sp, uv.x, uv.y, r)) add(AREA << 30 | i, 1, areaSamples);
+            }
+            else for (int v = 0; v < area.vSteps[i]; ++v) for (int u = 0; u < area.uSteps[i]; ++u)
+                if (ConnectArea(i, sp, (u + 0.5f) / area.uSteps[i], (v + 0.5f) / area.vSteps[i], r)) add(AREA << 30 | i, 1, area.uSteps[i] * area.vSteps[i]);
+        }
+        return;
+    }
+    // 'count' lights from the power distribution, as in Sample
+    if (cdf.empty()) return;
+    for (int s = 0; s < count; s++)
+    {
+        float pdf;
+        const int entry = Pick(pdf);
+        if (ConnectEntry(entry, sp, scene, frame * count + s, r)) add(cdfLight[entry], 1.0f / (pdf * count), 0);
+    }
+}
+
+float3 LightSet::Gather(const ShadowRay* rays, const uchar* visible, const int n)
+{
+    float3 result(0);
+    for (int k = 0; k < n;)
+    {
+        const ShadowRay& r = rays[k];
+        if (r.samples > 0)
+        {
+            // the points of an area light, summed before averaging, as in EvaluateArea
+            float3 sum(0.0f);
+            for (; k < n && rays[k].light == r.light; k++) sum += visible[k] ? rays[k].contribution : float3(0);
+            result += sum / float(r.samples);
+        }
+        else result += (visible[k] ? r.contribution : float3(0)) * r.scale, k++;
+    }
+    return result;
+}
+
+void LightSet::UpdateShadowCaches(const Scene& scene)
+{
+    if (!useShadowCache) return;
+    for (int i = 0; i < directional.Count(); i++) if (directional.enabled[i])
+        directional.cache[i].Update(scene, normalize(-float3(directional.dx[i], directional.dy[i], directional.dz[i])));
+}
@@ -0,0 +1,109 @@
+#pragma once
+struct ShadingPoint;
+
+// All lights of the scene, stored per type in structure-of-arrays form. Illuminate walks
+// the arrays type by type (point, directional, spot, area), so there is no virtual call or
+// pointer chase per light, and cheap rejections happen before the shadow ray.
+// Sample estimates the same sum with a fixed number of lights, picked in proportion to
+// their power; with many lights that is what keeps the cost per shading point constant.
+class LightSet
+{
+public:
+    enum Type { POINT = 0, DIRECTIONAL, SPOT, AREA };
+    struct PointLights
+    {
+        std::vector<float> x, y, z;         // position
+        std::vector<float3> color;
+        std::vector<uchar> enabled;
+        int Count() const { return (int)x.size(); }
+    };
+    struct DirectionalLights
+    {
+        std::vector<float> dx, dy, dz;      // direction the light travels in
+        std::vector<float3> color;
+        std::vector<uchar> enabled;
+        std::vector<ShadowCache> cache;     // visibility per voxel face, if useShadowCache is set
+        int Count() const { return (int)dx.size(); }
+    };
+    struct SpotLights
+    {
+        std::vector<float> x, y, z;         // position
+        std::vector<float> dx, dy, dz;      // normalized cone axis
+        std::vector<float3> color;
+        std::vector<float> range;
+        std::vector<float> angleDeg;        // full cone
+        std::vector<float> edgeRoughness;   // 0 = hard, 1 = fully soft
+        std::vector<float> cosOuter, cosInner; // derived from angleDeg and edgeRoughness by UpdateSpot
+        std::vector<uchar> enabled;
+        int Count() const { return (int)x.size(); }
+    };
+    struct AreaLights
+    {
+        std::vector<float3> corner, edge1, edge2, normal;
+        std::vector<float3> color;
+        std::vector<float> intensity;
+        std::vector<int> uSteps, vSteps;
+        std::vector<uchar> enabled;
+        int Count() const { return (int)corner.size(); }
+    };
+
+    int AddPoint(const float3& position, const float3& color);
+    int AddDirectional(const float3& direction, const float3& color);
+    int AddSpot(const float3& position, const float3& direction, const float3& color, const float range);
+    int AddArea(const float3& corner, const float3& edge1, const float3& edge2, const float3& color, const int u = 4, const int v = 4);
+    void UpdateSpot(const int i); // call after changing the angle or edge roughness of a spot light
+
+    // adds weight * (light arriving at sp) for every enabled light to 'result', one light at a time
+    void Illuminate(const ShadingPoint& sp, const Scene& scene, const float3& weight, float3& result) const;
+    // unbiased estimate of the same, from 'count' lights drawn from the power distribution;
+    // an area light gets one random point on its surface instead of its full grid
+    void Sample(const ShadingPoint& sp, const Scene& scene, const float3& weight, float3& result, const int count) const;
+    void UpdateDistribution(); // rebuild the power distribution; call when lights change
+    // area lights: 0 evaluates the full uSteps x vSteps grid every frame; 1..4 takes that many
+    // points per frame from a Sobol sequence that continues over the frames since 'frame' was
+    // reset, so the accumulator converges to the same image at a fraction of the cost
+    int areaSamples = 0;
+    uint frame = 0; // frames accumulated so far; set by the renderer
+    // directional lights: look visibility up per voxel face instead of tracing shadow rays
+    bool useShadowCache = false;
+    void UpdateShadowCaches(const Scene& scene); // call when the scene or a light may have changed
+    int EnabledCount() const { return (int)cdf.size(); }
+
+    // a light's contribution to a shading point, which counts if its shadow ray is unoccluded
+    struct ShadowRay
+    {
+        float3 O, D;
+        float t;                // distance to the light; 0 if visibility is known (shadow cache)
+        float3 contribution;
+        uint light;             // type << 30 | index
+        float scale = 1;        // Sample: 1 / (pdf * count)
+        int samples = 0;        // Illuminate, area light: points whose sum is averaged
+    };
+    // same estimate as Illuminate (count = 0) or Sample, but instead of tracing the shadow rays
+    // one by one, appends them to 'rays', so that the caller can sort and trace them in batches
+    void Connect(const ShadingPoint& sp, const Scene& scene, const int count, std::vector<ShadowRay>& rays) const;
+    // the light of the 'n' rays Connect appended for one point, given their visibility; adds them
+    // up in the order and with the arithmetic of Illuminate and Sample, so the result is the same
+    // to the bit, however the rays were sorted for tracing
+    static float3 Gather(const ShadowRay* rays, const uchar* visible, const int n);
+    static float3 Trace(const ShadowRay& r, const Scene& scene); // the contribution, or 0 if occluded
+
+    PointLights point;
+    DirectionalLights directional;
+    SpotLights spot;
+    AreaLights area;
+private:
+    // shadow ray and unoccluded contribution of one light; false if the light can't reach sp
+    bool ConnectPoint(const int i, const ShadingPoint& sp, ShadowRay& r) const;
+    bool ConnectDirectional(const int i, const ShadingPoint& sp, const Scene& scene, ShadowRay& r) const;
+    bool ConnectSpot(const int i, const ShadingPoint& sp, ShadowRay& r) const;
+    bool ConnectArea(const int i, const ShadingPoint& sp, const float u, const float v, ShadowRay& r) const;
+    bool ConnectEntry(const int entry, const ShadingPoint& sp, const Scene& scene, const uint index, ShadowRay& r) const;
+    float3 EvaluateArea(const int i, const ShadingPoint& sp, const Scene& scene) const;
+    int Pick(float& pdf) const;
+    float2 AreaSample(const int i, const ShadingPoint& sp, const uint index) const;
+    // power distribution over the enabled lights: running sum, and the light for each entry
+    // (type in the top two bits, index below)
+    std::vector<float> cdf;
+    std::vector<uint> cdfLight;
+};
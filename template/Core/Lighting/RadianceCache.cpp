@@ -0,0 +1,99 @@
+#include "template.h"
+
+// FNV-1a over raw bytes
+static uint64_t HashBytes(uint64_t h, const void* data, const size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) h = (h ^ ((const uchar*)data)[i]) * 0x100000001b3ull;
+    return h;
+}
+template <class T> static uint64_t HashVector(const uint64_t h, const std::vector<T>& v) { return HashBytes(h, v.data(), v.size() * sizeof(T)); }
+
+void RadianceCache::Clear()
+{
+    if (!entries) entries.reset(new Entry[CAPACITY]);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)CAPACITY; i++)
+    {
+        Entry& e = entries[i];
+        e.key.store(0, std::memory_order_relaxed), e.count.store(0, std::memory_order_relaxed);
+        e.done.store(0, std::memory_order_relaxed);
+        e.sum[0] = e.sum[1] = e.sum[2] = 0;
+    }
+}
+
+uint64_t RadianceCache::Signature(const LightSet& lights, const Scene& scene)
+{
+    uint64_t h = HashBytes(0xcbf29ce484222325ull, &scene.version, sizeof(scene.version));
+    h = HashVector(h, lights.point.x), h = HashVector(h, lights.point.y), h = HashVector(h, lights.point.z);
+    h = HashVector(h, lights.point.color), h = HashVector(h, lights.point.enabled);
+    h = HashVector(h, lights.directional.dx), h = HashVector(h, lights.directional.dy), h = HashVector(h, lights.directional.dz);
+    h = HashVector(h, lights.directional.color), h = HashVector(h, lights.directional.enabled);
+    h = HashVector(h, lights.spot.x), h = HashVector(h, lights.spot.y), h = HashVector(h, lights.spot.z);
+    h = HashVector(h, lights.spot.dx), h = HashVector(h, lights.spot.dy), h = HashVector(h, lights.spot.dz);
+    h = HashVector(h, lights.spot.color), h = HashVector(h, lights.spot.range), h = HashVector(h, lights.spot.cosOuter);
+    h = HashVector(h, lights.spot.cosInner), h = HashVector(h, lights.spot.enabled);
+    h = HashVector(h, lights.area.corner), h = HashVector(h, lights.area.edge1), h = HashVector(h, lights.area.edge2);
+    h = HashVector(h, lights.area.color), h = HashVector(h, lights.area.intensity), h = HashVector(h, lights.area.enabled);
+    h = HashVector(h, lights.area.uSteps), h = HashVector(h, lights.area.vSteps);
+    // materials field by field: the struct has padding
+    for (uint i = 0; i < scene.materialCount; i++)
+    {
+        const Material& m = scene.materials[i];
+        h = HashBytes(h, &m.type, sizeof(m.type)), h = HashBytes(h, &m.albedo, sizeof(m.albedo));
+        h = HashBytes(h, &m.emission, sizeof(m.emission)), h = HashBytes(h, &m.emissionStr, sizeof(m.emissionStr));
+    }
+    return h;
+}
+
+uint64_t RadianceCache::Key(const float3& position, const float3& normal)
+{
+    // the voxel behind the face, and the face: axis * 2 + (normal points along +axis)
+    const float3 V = (position - normal * (0.5f / WORLDSIZE)) * (float)WORLDSIZE;
+    const uint64_t x = clamp((int)floorf(V.x), 0, WORLDSIZE - 1);
+    const uint64_t y = clamp((int)floorf(V.y), 0, WORLDSIZE - 1);
+    const uint64_t z = clamp((int)floorf(V.z), 0, WORLDSIZE - 1);
+    const uint axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    return 1 + (x + y * WORLDSIZE + z * WORLDSIZE2) * 6 + axis * 2 + (normal[axis] > 0 ? 1 : 0);
+}
+
+// linear probing from the key's hash; with 'insert', claims a free entry for the key
+RadianceCache::Entry* RadianceCache::Find(const uint64_t key, const bool insert) const
+{
+    const uint first = (uint)((key * 0x9e3779b97f4a7c15ull) >> 40) & (CAPACITY - 1);
+    for (int probe = 0; probe < MAX_PROBES; probe++)
+    {
+        Entry& e = entries[(first + probe) & (CAPACITY - 1)];
+        uint64_t k = e.key.load(std::memory_order_acquire);
+        if (k == key) return &e;
+        if (k != 0) continue;
+        if (!insert) return nullptr;
+        if (e.key.compare_exchange_strong(k, key) || k == key) return &e;
+    }
+    return nullptr;
+}
+
+bool RadianceCache::Lookup(const float3& position, const float3& normal, float3& radiance) const
+{
+    const Entry* e = Find(Key(position, normal), false);
+    if (!e) return false;
+    // the acquire pairs with the release in Add: every sample counted in n is in sum
+    const uint n = e->done.load(std::memory_order_acquire);
+    if (n < samplesToConverge) return false;
+    radiance = float3(e->sum[0], e->sum[1], e->sum[2]) * (1.0f / n);
+    return true;
+}
+
+void RadianceCache::Add(const float3& position, const float3& normal, const float3& radiance)
+{
+    Entry* e = Find(Key(position, normal), true);
+    if (!e || e->count.load(std::memory_order_relaxed) >= samplesToConverge) return;
+    // claim a slot first, so concurrent adds can not push the entry past samplesToConverge
+    if (e->count.fetch_add(1, std::memory_order_relaxed) >= samplesToConverge) return;
+#pragma omp atomic
+    e->sum[0] += radiance.x;
+#pragma omp atomic
+    e->sum[1] += radiance.y;
+#pragma omp atomic
+    e->sum[2] += radiance.z;
+    e->done.fetch_add(1, std::memory_order_release);
+}
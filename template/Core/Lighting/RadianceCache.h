@@ -0,0 +1,35 @@
+#pragma once
+
+// Direct light per voxel face, for Lambertian surfaces. Normals are voxel aligned and the
+// scene is static between edits, so the light leaving a face hardly depends on where on the
+// face a ray lands. Shading adds its estimates to the face's entry until it holds
+// 'samplesToConverge' of them; from then on the average replaces the light evaluation.
+// Entries live in a fixed-size hash table keyed by (voxel, axis, sign), filled lazily from
+// all threads; when the table is full, faces simply stay uncached. Clear it when the
+// lights, materials or voxels change (see Signature).
+class RadianceCache
+{
+public:
+    static constexpr uint CAPACITY = 1 << 20; // entries; power of 2
+    static constexpr int MAX_PROBES = 16;
+    void Clear(); // also allocates the table, on first use
+    // true if the face at 'position' with voxel normal 'normal' converged; 'radiance' gets its average
+    bool Lookup(const float3& position, const float3& normal, float3& radiance) const;
+    void Add(const float3& position, const float3& normal, const float3& radiance);
+    static uint64_t Signature(const LightSet& lights, const Scene& scene); // changes when cached light goes stale
+    size_t MemoryUsage() const { return entries ? CAPACITY * sizeof(Entry) : 0; }
+    uint samplesToConverge = 64;
+    uint64_t signature = 0;                     // of the lights, materials and voxels the entries belong to
+    std::atomic<uint64_t> lookups{ 0 }, hits{ 0 }; // statistics; the renderer resets them every frame
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> key;              // 1 + face index; 0 for a free entry
+        float sum[3];
+        std::atomic<uint> count;                // samples claimed by Add; it drops the rest
+        std::atomic<uint> done;                 // samples added to sum; published with release
+    };
+    static uint64_t Key(const float3& position, const float3& normal);
+    Entry* Find(const uint64_t key, const bool insert) const;
+    std::unique_ptr<Entry[]> entries;
+};
@@ -0,0 +1,56 @@
+#include "template.h"
+
+bool ShadowCache::Update(const Scene& scene, const float3& toLight)
+{
+    if (version == scene.version && direction.x == toLight.x && direction.y == toLight.y && direction.z == toLight.z) return false;
+    Timer timer;
+    direction = toLight, version = scene.version;
+    bits.assign((size_t)scene.brickCount * 3 * WORDS, 0);
+    const float voxelSize = 1.0f / WORLDSIZE;
+    const int3 step = make_int3(toLight.x > 0 ? 1 : -1, toLight.y > 0 ? 1 : -1, toLight.z > 0 ? 1 : -1);
+#pragma omp parallel for schedule(dynamic)
+    for (int cell = 0; cell < GRIDSIZE3; cell++)
+    {
+        const int3 origin = make_int3(cell % GRIDSIZE, (cell / GRIDSIZE) % GRIDSIZE, cell / GRIDSIZE2) * BRICKSIZE;
+        const uint b = scene.grid[GridIndex(origin.x / BRICKSIZE, origin.y / BRICKSIZE, origin.z / BRICKSIZE)];
+        if (!b) continue;
+        const Voxel* voxels = scene.brick + (size_t)(b - 1) * BRICKSIZE3;
+        uint64_t* brickBits = &bits[(size_t)(b - 1) * 3 * WORDS];
+        for (int i = 0; i < BRICKSIZE3; i++)
+        {
+            // bits are indexed like the voxels, by BrickOffset
+            const int3 P = origin + make_int3(i & (BRICKSIZE - 1), (i / BRICKSIZE) & (BRICKSIZE - 1), i / BRICKSIZE2);
+            const uint local = BrickOffset(P.x, P.y, P.z);
+            if (!voxels[local]) continue;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (toLight[axis] == 0) continue; // faces parallel to the light are never lit
+                int3 N = P;
+                N[axis] += step[axis];
+                // a face against another voxel is never hit
+                const bool inWorld = N[axis] >= 0 && N[axis] < WORLDSIZE;
+                if (inWorld && scene.Get(N.x, N.y, N.z)) continue;
+                // shadow ray from the center of the empty neighbour: half a voxel above the face,
+                // as in LightSet::ConnectDirectional
+                Ray ray((float3(N) + 0.5f) * voxelSize, toLight);
+                if (!scene.IsOccluded(ray)) brickBits[axis * WORDS + local / 64] |= 1ull << (local & 63);
+            }
+        }
+    }
+    buildMs = timer.elapsed() * 1000.0f;
+    return true;
+}
+
+bool ShadowCache::Visible(const Scene& scene, const float3& position, const float3& normal) const
+{
+    // the voxel behind the face
+    const float3 V = (position - normal * (0.5f / WORLDSIZE)) * (float)WORLDSIZE;
+    const int x = clamp((int)floorf(V.x), 0, WORLDSIZE - 1);
+    const int y = clamp((int)floorf(V.y), 0, WORLDSIZE - 1);
+    const int z = clamp((int)floorf(V.z), 0, WORLDSIZE - 1);
+    const uint b = scene.grid[GridIndex(x / BRICKSIZE, y / BRICKSIZE, z / BRICKSIZE)];
+    if (!b) return true;
+    const uint axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    const uint local = BrickOffset(x, y, z);
+    return (bits[((size_t)(b - 1) * 3 + axis) * WORDS + local / 64] >> (local & 63)) & 1;
+}
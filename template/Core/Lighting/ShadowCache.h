@@ -0,0 +1,21 @@
+#pragma once
+
+// Visibility of a directional light per voxel face. Towards a fixed direction only three
+// faces of a voxel can be lit, one per axis, so every brick gets 3 x BRICKSIZE3 bits: bit set
+// if the shadow ray from that face reaches the sky. Lambertian shading then looks the bit up
+// instead of tracing a shadow ray; shadows become exact per face instead of per pixel.
+// Update rebuilds the bits (in parallel) when the direction or the voxel data changed.
+class ShadowCache
+{
+public:
+    static constexpr int WORDS = BRICKSIZE3 / 64; // 64-bit words per brick and axis
+    bool Update(const Scene& scene, const float3& toLight); // returns true if it rebuilt the cache
+    // visibility of the face of the voxel hit at 'position', with normal 'normal' towards the light
+    bool Visible(const Scene& scene, const float3& position, const float3& normal) const;
+    size_t MemoryUsage() const { return bits.size() * sizeof(uint64_t); }
+    float3 direction = float3(0); // direction towards the light, at the last build
+    uint version = ~0u;           // Scene::version at the last build
+    float buildMs = 0;
+private:
+    std::vector<uint64_t> bits;   // per brick: three axes of WORDS words, indexed like Scene::brick
+};
@@ -5,4 +5,5 @@ struct ShadingPoint
     float3 position;
     float3 normal;
     float3 albedo;
+    uint pixel = 0; // screen pixel of the path; selects the pixel's own light sample sequence
 };
@@ -0,0 +1,237 @@
+// Template, IGAD version 2026
+// IGAD/NHTV/BUAS/UU - Jacco Bikker - 2006-2026
+
+// Headless entry point: no window, OpenGL or OpenCL. Renders a fixed number of
+// accumulated frames from a fixed camera, writes the result to disk and prints
+// throughput statistics. Built by CMakeLists.txt (define HEADLESS).
+
+#include "template.h"
+
+#ifdef HEADLESS
+
+using namespace Tmpl8;
+
+// static member data for instruction set support class
+static const CPUCaps cpucaps;
+
+// no window: no focus, no keys
+bool WindowHasFocus() { return false; }
+bool IsKeyDown( const uint ) { return false; }
+
+void FatalError( const char* fmt, ... )
+{
+	va_list args;
+	va_start( args, fmt );
+	vfprintf( stderr, fmt, args );
+	va_end( args );
+	fprintf( stderr, "\n" );
+	exit( 1 );
+}
+
+#ifndef BENCHMARK // voxpopuli_bench has its own entry point, in benchmark.cpp
+
+// write a 32-bit big-endian value
+static void WriteBE( FILE* f, const uint v )
+{
+	const uchar b[4] = { (uchar)(v >> 24), (uchar)(v >> 16), (uchar)(v >> 8), (uchar)v };
+	fwrite( b, 1, 4, f );
+}
+
+static void WritePNGChunk( FILE* f, const char* type, const uchar* data, const uint size )
+{
+	WriteBE( f, size );
+	fwrite( type, 1, 4, f );
+	if (size) fwrite( data, 1, size, f );
+	uint crc = (uint)crc32( 0, (const Bytef*)type, 4 );
+	if (size) crc = (uint)crc32( crc, data, size );
+	WriteBE( f, crc );
+}
+
+// 8-bit RGB png of the screen, compressed with zlib
+static bool WritePNG( const char* file, const Surface& s )
+{
+	FILE* f = fopen( file, "wb" );
+	if (!f) return false;
+	vector<uchar> raw( (size_t)(s.width * 3 + 1) * s.height );
+	for (int y = 0; y < s.height; y++)
+	{
+		uchar* line = &raw[(size_t)(s.width * 3 + 1) * y];
+		*line++ = 0; // filter type: none
+		for (int x = 0; x < s.width; x++)
+		{
+			const uint c = s.pixels[x + y * s.width];
+			*line++ = (uchar)(c >> 16), * line++ = (uchar)(c >> 8), * line++ = (uchar)c;
+		}
+	}
+	uLongf packedSize = compressBound( (uLong)raw.size() );
+	vector<uchar> packed( packedSize );
+	compress2( packed.data(), &packedSize, raw.data(), (uLong)raw.size(), 6 );
+	const uchar signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	fwrite( signature, 1, 8, f );
+	uchar header[13] = { 0 };
+	for (int i = 0; i < 4; i++) header[i] = (uchar)(s.width >> (24 - 8 * i)), header[4 + i] = (uchar)(s.height >> (24 - 8 * i));
+	header[8] = 8, header[9] = 2; // 8 bits per channel, RGB
+	WritePNGChunk( f, "IHDR", header, 13 );
+	WritePNGChunk( f, "IDAT", packed.data(), (uint)packedSize );
+	WritePNGChunk( f, "IEND", 0, 0 );
+	fclose( f );
+	return true;
+}
+
+// floating point pfm of the averaged accumulator, rows stored bottom to top
+static bool WritePFM( const char* file, const float3* pixels, const int w, const int h, const float scale )
+{
+	FILE* f = fopen( file, "wb" );
+	if (!f) return false;
+	fprintf( f, "PF\n%i %i\n-1.0\n", w, h );
+	for (int y = h - 1; y >= 0; y--) for (int x = 0; x < w; x++)
+	{
+		const float3 c = pixels[x + y * w] * scale;
+		fwrite( &c.x, 4, 1, f ), fwrite( &c.y, 4, 1, f ), fwrite( &c.z, 4, 1, f );
+	}
+	fclose( f );
+	return true;
+}
+
+static void Usage()
+{
+	printf( "usage: voxpopuli_headless [options]\n"
+		"  --frames N          frames (samples per pixel) to accumulate, default 16\n"
+		"  --out FILE          result, .png or .pfm; default render.png\n"
+		"  --camera FILE       camera file, default camera.bin if present\n"
+		"  --pos X Y Z         camera position, overrides the camera file\n"
+		"  --target X Y Z      camera target, overrides the camera file\n"
+		"  --wavefront 0|1     wavefront pipeline or recursive Trace, default 1\n"
+		"  --packets 0|1       8-wide packets for primary rays, default 1 (needs AVX2)\n"
+		"  --tiles 0|1         recursive Trace: tile scheduler or OpenMP rows, default 1\n"
+		"  --light-samples N   lights sampled per shading point; 0 evaluates all lights, default 1\n"
+		"  --area-samples N    area light points per frame, 1..4; default 0, the full grid\n"
+		"  --shadow-batches 0|1  wavefront: sorted batches of shadow rays, default 1\n"
+		"  --shadow-cache 0|1  directional light visibility per voxel face, default 0\n"
+		"  --radiance-cache N  reuse direct light per voxel face after N samples; default 0, off\n"
+		"  --beam 0|1          primary rays skip the empty space found by a cone per 8x8 tile, default 1\n"
+		"  --reprojection 0|1  reproject the image when the camera moves, default 1\n"
+		"  --denoise 0|1       a-trous filter on the result (png only), default 0\n"
+		"  --adaptive E        skip tiles whose relative error is below E; default 0, off\n"
+		"  --move DX DY DZ     move the camera by this much every frame\n"
+		"  --world FILE        map a saved world instead of the default scene\n"
+		"  --save-world FILE   save the world after loading models, for --world\n"
+		"  --clear             start from an empty world instead of the default scene\n"
+		"  --model FILE X Y Z S  add a voxel model at voxel X Y Z, scaled by S (repeatable)\n" );
+}
+
+// Application entry point
+int main( int argc, char** argv )
+{
+	// set fp flags: denormalize & flush to zero
+	_mm_setcsr( _mm_getcsr() | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON) );
+	// command line
+	int frames = 16, wavefront = 1, packets = 1, tiles = 1, lightSamples = 1, areaSamples = 0, shadowBatches = 1, shadowCache = 0, radianceCache = 0, reprojection = 1, denoise = 0, beam = 1;
+	float adaptive = 0;
+	const char* out = "render.png", * cameraFile = 0, * worldFile = 0, * saveWorld = 0;
+	float3 pos, target, move( 0 );
+	bool hasPos = false, hasTarget = false, clear = false;
+	vector<Scene::ModelPlacement> models;
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		const int left = argc - 1 - i;
+		if (arg == "--frames" && left >= 1) frames = max( 1, atoi( argv[++i] ) );
+		else if (arg == "--out" && left >= 1) out = argv[++i];
+		else if (arg == "--camera" && left >= 1) cameraFile = argv[++i];
+		else if (arg == "--wavefront" && left >= 1) wavefront = atoi( argv[++i] );
+		else if (arg == "--packets" && left >= 1) packets = atoi( argv[++i] );
+		else if (arg == "--tiles" && left >= 1) tiles = atoi( argv[++i] );
+		else if (arg == "--light-samples" && left >= 1) lightSamples = atoi( argv[++i] );
+		else if (arg == "--area-samples" && left >= 1) areaSamples = clamp( atoi( argv[++i] ), 0, 4 );
+		else if (arg == "--shadow-batches" && left >= 1) shadowBatches = atoi( argv[++i] );
+		else if (arg == "--shadow-cache" && left >= 1) shadowCache = atoi( argv[++i] );
+		else if (arg == "--radiance-cache" && left >= 1) radianceCache = atoi( argv[++i] );
+		else if (arg == "--beam" && left >= 1) beam = atoi( argv[++i] );
+		else if (arg == "--reprojection" && left >= 1) reprojection = atoi( argv[++i] );
+		else if (arg == "--denoise" && left >= 1) denoise = atoi( argv[++i] );
+		else if (arg == "--adaptive" && left >= 1) adaptive = (float)atof( argv[++i] );
+		else if (arg == "--move" && left >= 3) move = float3( (float)atof( argv[i + 1] ), (float)atof( argv[i + 2] ), (float)atof( argv[i + 3] ) ), i += 3;
+		else if (arg == "--pos" && left >= 3) pos = float3( (float)atof( argv[i + 1] ), (float)atof( argv[i + 2] ), (float)atof( argv[i + 3] ) ), i += 3, hasPos = true;
+		else if (arg == "--clear") clear = true;
+		else if (arg == "--world" && left >= 1) worldFile = argv[++i];
+		else if (arg == "--save-world" && left >= 1) saveWorld = argv[++i];
+		else if (arg == "--model" && left >= 5)
+		{
+			Scene::ModelPlacement m;
+			m.file = argv[i + 1], m.position = make_int3( atoi( argv[i + 2] ), atoi( argv[i + 3] ), atoi( argv[i + 4] ) );
+			m.scale = (float)atof( argv[i + 5] ), i += 5;
+			models.push_back( m );
+		}
+		else if (arg == "--target" && left >= 3) target = float3( (float)atof( argv[i + 1] ), (float)atof( argv[i + 2] ), (float)atof( argv[i + 3] ) ), i += 3, hasTarget = true;
+		else { Usage(); return arg == "--help" ? 0 : 1; }
+	}
+	// initialize application
+	Surface* screen = new Surface( SCRWIDTH, SCRHEIGHT );
+	Renderer* app = new Renderer();
+	app->screen = screen;
+	app->Init();
+	app->useWavefront = wavefront != 0, app->usePackets = packets != 0, app->useTiles = tiles != 0;
+	app->sampleLights = lightSamples > 0, app->lightSamples = max( 1, lightSamples );
+	app->lights.areaSamples = areaSamples, app->batchShadows = shadowBatches != 0;
+	app->lights.useShadowCache = shadowCache != 0;
+	app->useRadianceCache = radianceCache > 0, app->radianceCache.samplesToConverge = max( 1, radianceCache );
+	app->useReprojection = reprojection != 0, app->useDenoiser = denoise != 0, app->useBeamPrepass = beam != 0;
+	app->adaptiveSampling = adaptive > 0, app->adaptiveThreshold = adaptive;
+	if (worldFile)
+	{
+		Timer timer;
+		if (!app->scene.Map( worldFile )) FatalError( "Could not map %s", worldFile );
+		printf( "mapped %s in %.2f ms\n", worldFile, timer.elapsed() * 1000 );
+	}
+	if (clear) app->scene.Clear();
+	if (!models.empty())
+	{
+		Timer timer;
+		const int loaded = app->scene.LoadModels( models );
+		if (loaded < (int)models.size()) FatalError( "Could not load %i of %i models", (int)models.size() - loaded, (int)models.size() );
+		printf( "loaded %i models in %.1f ms, %u materials\n", loaded, timer.elapsed() * 1000, app->scene.materialCount );
+	}
+	if (saveWorld && !app->scene.Save( saveWorld )) FatalError( "Could not write %s", saveWorld );
+	Camera& camera = app->camera;
+	if (cameraFile)
+	{
+		FILE* f = fopen( cameraFile, "rb" );
+		if (!f) FatalError( "File not found: %s", cameraFile );
+		fread( &camera, 1, sizeof( Camera ), f );
+		fclose( f );
+	}
+	if (hasPos || hasTarget) camera.LookAt( hasPos ? pos : camera.camPos, hasTarget ? target : camera.camTarget );
+	// render
+	double seconds = 0, rays = 0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if (frame > 0 && (move.x != 0 || move.y != 0 || move.z != 0)) camera.LookAt( camera.camPos + move, camera.camTarget + move );
+		Timer timer;
+		app->Tick( 0 );
+		seconds += timer.elapsed();
+		rays += (double)app->raysPerPixel * SCRWIDTH * SCRHEIGHT;
+	}
+	const double primary = (double)frames * SCRWIDTH * SCRHEIGHT;
+	printf( "%i x %i, %u spp: %.2f ms/frame, %.2f Mrays/s (%.2f Mrays/s primary), %.2f rays/pixel/frame\n",
+		SCRWIDTH, SCRHEIGHT, app->sampleCount, 1000 * seconds / frames, rays / (seconds * 1e6), primary / (seconds * 1e6), rays / primary );
+	// save the result
+	const string name = out;
+	const bool pfm = name.size() >= 4 && name.compare( name.size() - 4, 4, ".pfm" ) == 0;
+	const bool ok = pfm ? WritePFM( out, app->accumulator, SCRWIDTH, SCRHEIGHT, 1.0f / app->sampleCount ) : WritePNG( out, *screen );
+	if (!ok) FatalError( "Could not write %s", out );
+	if (app->useDenoiser) printf( "denoiser: prepare %.2f ms, filter %.2f ms, output %.2f ms\n",
+		app->denoiser.stageMs[Denoiser::PREPARE], app->denoiser.stageMs[Denoiser::FILTER], app->denoiser.stageMs[Denoiser::OUTPUT] );
+	printf( "%.1f traversal steps per primary ray\n", app->usePackets && CPUCaps::HW_AVX2 ? app->packetStepsPerRay : app->stepsPerRay[app->scene.backend] );
+	if (app->useBeamPrepass) printf( "beam prepass: %.2f ms\n", app->beamMs );
+	if (app->adaptiveSampling) printf( "adaptive: %.1f%% of the pixels active in the last frame, %i samples each\n",
+		100 * app->activeFraction, app->samplesPerPixel );
+	if (app->useRadianceCache) printf( "radiance cache: %.1f%% hits in the last frame\n", 100 * app->radianceHitRate );
+	printf( "saved %s\n", out );
+	// the renderer is not deleted: its camera would overwrite camera.bin on destruction
+	return 0;
+}
+
+#endif // BENCHMARK
+
+#endif // HEADLESS
@@ -3,6 +3,9 @@
 
 #include "template.h"
 
+// the window, OpenGL and the interactive main loop; HEADLESS builds use headless.cpp instead
+#ifndef HEADLESS
+
 #pragma comment( linker, "/subsystem:windows /ENTRY:mainCRTStartup" )
 
 using namespace Tmpl8;
@@ -208,6 +211,8 @@ void main()
 	glfwTerminate();
 }
 
+#endif // HEADLESS
+
 // Helper functions
 bool FileIsNewer( const char* file1, const char* file2 )
 {
@@ -270,6 +275,8 @@ void TextFileWrite( const string& text, const char* _File )
 	s.write( text.c_str(), len );
 }
 
+#ifndef HEADLESS
+
 /*
 
 	OpenGL loader generated by glad 0.1.36 on Wed Jun  4 11:52:06 2025.
@@ -2804,4 +2811,6 @@ int gladLoadGLLoader( GLADloadproc load ) {
 	return GLVersion.major != 0 || GLVersion.minor != 0;
 }
 
-// EOF
\ No newline at end of file
+// EOF
+
+#endif // HEADLESS
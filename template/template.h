@@ -5,12 +5,19 @@
 #include <chrono>
 #include <fstream>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
 #include <list>
 #include <string>
 #include <math.h>
 #include <algorithm>
 #include <assert.h>
+#ifdef _MSC_VER
 #include <io.h>
+#endif
 
 // header for AVX, and every technology before it.
 // if your CPU does not support this (unlikely), include the appropriate header instead.
@@ -78,7 +85,9 @@ using namespace std;
 #define NODEFERWINDOWPOS
 #define NOMCX
 #define NOIME
+#ifdef _WIN32
 #include "windows.h"
+#endif
 
 // aligned memory allocations
 #ifdef _MSC_VER
@@ -100,8 +109,10 @@ using namespace std;
 
 // imgui
 #include "imgui.h"
+#ifndef HEADLESS
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#endif
 
 // template headers
 #include "surface.h"
@@ -112,12 +123,6 @@ using namespace Tmpl8;
 // math classes
 #include "tmpl8math.h"
 
-// OpenCL headers
-// #define CL_USE_DEPRECATED_OPENCL_2_0_APIS // safe; see https://stackoverflow.com/a/28500846
-#define CL_TARGET_OPENCL_VERSION 300
-#include "cl/cl.h"
-#include <cl/cl_gl.h>
-
 // cross-platform directory access
 #ifdef _MSC_VER
 #include <direct.h>
@@ -125,8 +130,21 @@ using namespace Tmpl8;
 #define chdir _chdir
 #else
 #include <unistd.h>
+#include <sys/stat.h>
 #endif
 
+// zlib
+#include "zlib.h"
+
+// HEADLESS builds render without a window, OpenGL or OpenCL; see headless.cpp
+#ifndef HEADLESS
+
+// OpenCL headers
+// #define CL_USE_DEPRECATED_OPENCL_2_0_APIS // safe; see https://stackoverflow.com/a/28500846
+#define CL_TARGET_OPENCL_VERSION 300
+#include "cl/cl.h"
+#include <cl/cl_gl.h>
+
 // GLFW
 #define GLFW_USE_CHDIR 0
 #define GLFW_EXPOSE_NATIVE_WIN32
@@ -135,13 +153,18 @@ using namespace Tmpl8;
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 
-// zlib
-#include "zlib.h"
-
 // opencl & opencl
 #include "opencl.h"
 #include "opengl.h"
 
+#else
+
+// headless: GLFW only for its key codes
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#endif
+
 // fatal error reporting (with a pretty window)
 #define FATALERROR( fmt, ... ) FatalError( "Error on line %d of %s: " fmt "\n", __LINE__, __FILE__, ##__VA_ARGS__ )
 #define FATALERROR_IF( condition, fmt, ... ) do { if ( ( condition ) ) FATALERROR( fmt, ##__VA_ARGS__ ); } while ( 0 )
@@ -150,6 +173,7 @@ using namespace Tmpl8;
 
 // global keystate array access
 bool IsKeyDown( const uint key );
+bool WindowHasFocus();
 
 // timer
 struct Timer
@@ -186,14 +210,16 @@ void TextFileWrite( const string& text, const char* _File );
 #include <iostream>
 #include <bitset>
 #include <array>
+#ifdef _MSC_VER
 #include <intrin.h>
+#endif
 
 // instruction set detection
 #ifdef _WIN32
 #define cpuid(info, x) __cpuidex(info, x, 0)
 #else
 #include <cpuid.h>
-void cpuid( int info[4], int InfoType ) { __cpuid_count( InfoType, 0, info[0], info[1], info[2], info[3] ); }
+inline void cpuid( int info[4], int InfoType ) { __cpuid_count( InfoType, 0, info[0], info[1], info[2], info[3] ); }
 #endif
 class CPUCaps // from https://github.com/Mysticial/FeatureDetector
 {
@@ -333,8 +359,15 @@ public:
 };
 
 #include "ray.h"
+#include "tree64.h"
 #include "scene.h"
 #include "camera.h"
+#include "wavefront.h"
+#include "tilescheduler.h"
+#include "denoiser.h"
+#include "Core/Lighting/ShadowCache.h"
+#include "Core/Lighting/LightSet.h"
+#include "Core/Lighting/RadianceCache.h"
 #include "renderer.h"
 
 // EOF
\ No newline at end of file
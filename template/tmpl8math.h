@@ -143,6 +143,7 @@ struct ALIGN( 4 ) uchar4
 using namespace Tmpl8;
 
 // random numbers
+uint WangHash( uint s );
 uint InitSeed( uint seedBase );
 uint RandomUInt();
 uint RandomUInt( uint& seed );
@@ -633,7 +634,7 @@ public:
 	mat2( float2 a, float2 b ) { cell[0] = a.x, cell[1] = b.x, cell[2] = a.y, cell[3] = b.y; }
 	// mat2( float2 a, float2 b ) { cell[0] = a.x, cell[1] = a.y, cell[2] = b.x, cell[3] = b.y; }
 	mat2( float a, float b, float c, float d ) { cell[0] = a, cell[1] = b, cell[2] = c, cell[3] = d; }
-	__declspec(align(16)) float cell[4] = { 1, 0, 0, 1 };
+	ALIGN( 16 ) float cell[4] = { 1, 0, 0, 1 };
 	constexpr static mat2 Identity() { return mat2{}; }
 	float operator()( const int i, const int j ) const { return cell[i * 2 + j]; }
 	float& operator()( const int i, const int j ) { return cell[i * 2 + j]; }
@@ -644,7 +645,7 @@ class mat4
 {
 public:
 	mat4() = default;
-	__declspec(align(64)) float cell[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	ALIGN( 64 ) float cell[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
 	float& operator [] ( const int idx ) { return cell[idx]; }
 	const float& operator [] ( const int idx ) const { return cell[idx]; }
 	float operator()( const int i, const int j ) const { return cell[i * 4 + j]; }
@@ -1045,8 +1046,14 @@ public:
 	{
 		struct
 		{
+#ifdef _MSC_VER
 			union { __m128 bmin4; float bmin[4]; struct { float3 bmin3; }; };
 			union { __m128 bmax4; float bmax[4]; struct { float3 bmax3; }; };
+#else
+			// gcc and clang reject members with constructors in anonymous structs
+			union { __m128 bmin4; float bmin[4]; };
+			union { __m128 bmax4; float bmax[4]; };
+#endif
 		};
 		__m128 bounds[2] = { _mm_setr_ps( 1e34f, 1e34f, 1e34f, 0 ), _mm_setr_ps( -1e34f, -1e34f, -1e34f, 0 ) };
 	};
@@ -1074,6 +1081,7 @@ float half_to_float( const half x );
 half float_to_half( const float x );
 
 // bad float detection (method from OpenCV)
+#ifdef _MSC_VER // elsewhere these clash with the C library versions
 inline bool isnan( const float value )
 {
 	const uint ieee754 = *reinterpret_cast<const uint*>(&value);
@@ -1084,6 +1092,7 @@ inline bool isinf( const float value )
 	const uint ieee754 = *reinterpret_cast<const uint*>(&value);
 	return (ieee754 & 0x7fffffff) == 0x7f800000;
 }
+#endif
 inline bool badfloat( const float value )
 {
 	const uint ieee754 = *reinterpret_cast<const uint*>(&value);
@@ -0,0 +1,101 @@
+#include "template.h"
+#include <omp.h>
+
+// interleave the lower 16 bits of x and y
+static uint Morton2( const uint x, const uint y )
+{
+	uint m = 0;
+	for (int i = 0; i < 16; i++) m |= ((x >> i) & 1) << (2 * i) | ((y >> i) & 1) << (2 * i + 1);
+	return m;
+}
+
+void TileScheduler::Init( const int width, const int height, const int size )
+{
+	tileSize = size;
+	tiles.clear();
+	const int tx = (width + size - 1) / size, ty = (height + size - 1) / size;
+	for (int y = 0; y < ty; y++) for (int x = 0; x < tx; x++) tiles.push_back( make_int2( x, y ) );
+	std::sort( tiles.begin(), tiles.end(), []( const int2& a, const int2& b ) { return Morton2( a.x, a.y ) < Morton2( b.x, b.y ); } );
+	for (int2& t : tiles) t = t * size;
+}
+
+int TileScheduler::Pop( const int thread )
+{
+	Range& r = ranges[thread];
+	std::lock_guard<std::mutex> guard( r.lock );
+	const int begin = r.begin.load( std::memory_order_relaxed );
+	if (begin >= r.end.load( std::memory_order_relaxed )) return -1;
+	r.begin.store( begin + 1, std::memory_order_relaxed );
+	unclaimed.fetch_sub( 1, std::memory_order_relaxed );
+	return begin;
+}
+
+int TileScheduler::Steal( const int thread )
+{
+	while (1)
+	{
+		// pick the victim with the most work left. The counts are a hint, read without the locks;
+		// the steal itself checks again under the lock
+		int victim = -1, most = 0;
+		for (int i = 1; i < threadCount; i++)
+		{
+			const int v = (thread + i) % threadCount;
+			const int left = ranges[v].end.load( std::memory_order_relaxed ) - ranges[v].begin.load( std::memory_order_relaxed );
+			if (left > most) victim = v, most = left;
+		}
+		if (victim < 0)
+		{
+			// all ranges look empty. Tiles a thief took from its victim but has not put in its own
+			// range yet are not in any range, so we are only done when every tile was claimed
+			if (unclaimed.load( std::memory_order_relaxed ) == 0) return -1;
+			_mm_pause();
+			continue;
+		}
+		int begin, end;
+		{
+			Range& r = ranges[victim];
+			std::lock_guard<std::mutex> guard( r.lock );
+			const int first = r.begin.load( std::memory_order_relaxed );
+			end = r.end.load( std::memory_order_relaxed );
+			if (first >= end) continue; // someone else got there first
+			begin = end - (end - first + 1) / 2;
+			r.end.store( begin, std::memory_order_relaxed );
+		}
+		// keep the rest of the stolen half as our own range, so it can be stolen again
+		Range& own = ranges[thread];
+		std::lock_guard<std::mutex> guard( own.lock );
+		own.begin.store( begin + 1, std::memory_order_relaxed ), own.end.store( end, std::memory_order_relaxed );
+		unclaimed.fetch_sub( 1, std::memory_order_relaxed );
+		return begin;
+	}
+}
+
+void TileScheduler::Run( const std::function<void( const int x0, const int y0 )>& job )
+{
+	const int T = omp_get_max_threads(), N = (int)tiles.size();
+	if (T != threadCount) ranges.reset( new Range[T] ), threadCount = T;
+	stats.assign( T, ThreadStats() );
+	for (int i = 0; i < T; i++) ranges[i].begin.store( N * i / T ), ranges[i].end.store( N * (i + 1) / T );
+	unclaimed.store( N );
+	Timer total;
+#pragma omp parallel num_threads( T )
+	{
+		const int thread = omp_get_thread_num();
+		ThreadStats& s = stats[thread];
+		Timer timer;
+		while (1)
+		{
+			int tile = Pop( thread );
+			if (tile < 0)
+			{
+				if ((tile = Steal( thread )) < 0) break;
+				s.steals++;
+			}
+			timer.reset();
+			job( tiles[tile].x, tiles[tile].y );
+			s.busyMs += timer.elapsed() * 1000.0f, s.tiles++;
+		}
+	}
+	const float totalMs = total.elapsed() * 1000.0f;
+	for (ThreadStats& s : stats) s.idleMs = max( 0.0f, totalMs - s.busyMs );
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Tile scheduler with work stealing. The screen is cut in square tiles, ordered along a
+// Morton curve so that consecutive tiles are close together on screen. Every thread starts
+// with a contiguous range of that order (its deque), takes tiles from the front of it, and
+// when it runs dry steals the back half of the fullest other range.
+
+namespace Tmpl8 {
+
+class TileScheduler
+{
+public:
+	struct ThreadStats
+	{
+		float busyMs = 0;		// time spent rendering tiles
+		float idleMs = 0;		// time spent looking for work or waiting for the other threads
+		uint tiles = 0;			// tiles rendered
+		uint steals = 0;		// successful steals
+	};
+	void Init( const int width, const int height, const int tileSize );
+	// run 'job' for every tile, on all OpenMP threads; job receives the tile's top-left pixel
+	void Run( const std::function<void( const int x0, const int y0 )>& job );
+	int tileSize = 0;
+	std::vector<int2> tiles;			// tile origins, in Morton order
+	std::vector<ThreadStats> stats;		// per thread, for the last Run
+private:
+	// begin and end change under the lock; Steal also reads them without it, to pick a victim
+	struct ALIGN( 64 ) Range { std::mutex lock; std::atomic<int> begin{ 0 }, end{ 0 }; };
+	int Pop( const int thread );
+	int Steal( const int thread );
+	std::unique_ptr<Range[]> ranges;
+	std::atomic<int> unclaimed{ 0 };	// tiles no thread has taken yet, stolen ones in transit included
+	int threadCount = 0;
+};
+
+} // namespace Tmpl8
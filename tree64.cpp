@@ -0,0 +1,94 @@
+#include "template.h"
+
+// true if the cube at 'pos' with side 'size' contains no solid voxels; uses the brick map
+static bool RegionEmpty( const Scene& scene, const int3 pos, const int size )
+{
+	if (pos.x >= WORLDSIZE || pos.y >= WORLDSIZE || pos.z >= WORLDSIZE) return true;
+	const int b0x = pos.x / BRICKSIZE, b0y = pos.y / BRICKSIZE, b0z = pos.z / BRICKSIZE;
+	const int bricks = max( 1, size / BRICKSIZE );
+	const int b1x = min( b0x + bricks, GRIDSIZE ), b1y = min( b0y + bricks, GRIDSIZE ), b1z = min( b0z + bricks, GRIDSIZE );
+	for (int z = b0z; z < b1z; z++) for (int y = b0y; y < b1y; y++) for (int x = b0x; x < b1x; x++)
+		if (scene.grid[GridIndex( x, y, z )]) return false;
+	return true;
+}
+
+uint Tree64::BuildNode( const Scene& scene, const int3 pos, const int size, Node& node )
+{
+	node.mask = 0;
+	if (size == 4)
+	{
+		// leaf: children are voxels
+		node.leaf = 1;
+		node.child = (uint)voxels.size();
+		for (int i = 0; i < 64; i++)
+		{
+			const int x = pos.x + (i & 3), y = pos.y + ((i >> 2) & 3), z = pos.z + (i >> 4);
+			if (x >= WORLDSIZE || y >= WORLDSIZE || z >= WORLDSIZE) continue;
+			const uint v = scene.Get( x, y, z );
+			if (v) node.mask |= 1ull << i, voxels.push_back( v );
+		}
+		return node.mask != 0;
+	}
+	// interior node: build the non-empty children first, then store them contiguously
+	Node kids[64];
+	uint count = 0;
+	const int childSize = size / 4;
+	for (int i = 0; i < 64; i++)
+	{
+		const int3 childPos = pos + make_int3( i & 3, (i >> 2) & 3, i >> 4 ) * childSize;
+		if (RegionEmpty( scene, childPos, childSize )) continue;
+		if (BuildNode( scene, childPos, childSize, kids[count] )) node.mask |= 1ull << i, count++;
+	}
+	node.leaf = 0;
+	node.child = (uint)nodes.size();
+	nodes.insert( nodes.end(), kids, kids + count );
+	return node.mask != 0;
+}
+
+void Tree64::Build( const Scene& scene )
+{
+	nodes.clear();
+	voxels.clear();
+	for (depth = 1; (1 << (2 * depth)) < WORLDSIZE; depth++);
+	Node rootNode;
+	empty = !BuildNode( scene, make_int3( 0 ), 1 << (2 * depth), rootNode );
+	root = (uint)nodes.size();
+	nodes.push_back( rootNode );
+}
+
+uint Tree64::Traverse( const Ray& ray, int3 P, float& t, uint& axis, const float tlimit, uint& steps ) const
+{
+	if (empty) return 0;
+	// work in voxel space, where every voxel is 1x1x1
+	const float3 O = ray.O * (float)WORLDSIZE, D = ray.D * (float)WORLDSIZE;
+	const float3 rD = ray.rD * (1.0f / WORLDSIZE), dirMask = 1.0f - ray.Dsign;
+	const int topShift = 2 * (depth - 1);
+	// stack of nodes containing P; after a step we only climb as far as needed
+	const Node* stack[16];
+	stack[0] = &nodes[root];
+	int level = 0;
+	while (t < tlimit)
+	{
+		steps++;
+		// descend to the deepest node that contains P
+		const Node* node = stack[level];
+		int shift = topShift - 2 * level;
+		while (1)
+		{
+			const uint i = ((P.x >> shift) & 3) + ((P.y >> shift) & 3) * 4 + ((P.z >> shift) & 3) * 16;
+			if (!(node->mask & (1ull << i))) break; // empty cell of 4^level voxels
+			const uint offset = (uint)_mm_popcnt_u64( node->mask & ((1ull << i) - 1) );
+			if (node->leaf) return voxels[node->child + offset];
+			stack[++level] = node = &nodes[node->child + offset];
+			shift -= 2;
+		}
+		// skip the whole empty cell in one step
+		const int3 prev = P;
+		ExitCell( O, D, rD, dirMask, 1 << shift, P, t, axis );
+		if ((uint)P.x >= WORLDSIZE || (uint)P.y >= WORLDSIZE || (uint)P.z >= WORLDSIZE) return 0;
+		// pop the nodes that no longer contain P
+		const int diff = (P.x ^ prev.x) | (P.y ^ prev.y) | (P.z ^ prev.z);
+		while (level > 0 && (diff >> (topShift - 2 * level + 2)) != 0) level--;
+	}
+	return 0;
+}
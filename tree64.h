@@ -0,0 +1,35 @@
+#pragma once
+
+// Sparse 64-tree: every node covers 4x4x4 children, stored as a 64-bit occupancy
+// mask plus the offset of its first child. Children of a node are stored
+// contiguously, so child i lives at 'child + popcount(mask & ((1 << i) - 1))'.
+// Leaf nodes (covering 4x4x4 voxels) point into 'voxels' instead of 'nodes'.
+
+namespace Tmpl8 {
+
+class Scene;
+
+class Tree64
+{
+public:
+	struct Node
+	{
+		uint64_t mask;	// one bit per child; set if the child contains solid voxels
+		uint child;		// index of the first child in 'nodes', or in 'voxels' for leaves
+		uint leaf;		// 1 if the children are voxel payloads
+	};
+	void Build( const Scene& scene );
+	// walk the tree starting at voxel P at distance t, entered through plane 'axis'.
+	// returns the payload of the first solid voxel before tlimit (t and axis updated), or 0.
+	uint Traverse( const Ray& ray, int3 P, float& t, uint& axis, const float tlimit, uint& steps ) const;
+	size_t MemoryUsage() const { return nodes.size() * sizeof( Node ) + voxels.size() * sizeof( uint ); }
+	std::vector<Node> nodes;
+	std::vector<uint> voxels;
+	uint root = 0;
+	int depth = 0;		// number of levels; the tree spans 4^depth voxels per side
+	bool empty = true;
+private:
+	uint BuildNode( const Scene& scene, const int3 pos, const int size, Node& node );
+};
+
+} // namespace Tmpl8
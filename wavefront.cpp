@@ -0,0 +1,283 @@
+#include "template.h"
+#include "Core/ShadingPoint.h"
+
+void RayQueue::Resize( const int n )
+{
+	for (std::vector<float>* v : { &Ox, &Oy, &Oz, &Dx, &Dy, &Dz, &t, &tstart }) v->resize( n );
+	voxel.resize( n ), axis.resize( n ), weight.resize( n ), pixel.resize( n ), flags.resize( n );
+}
+
+void RayQueue::Set( const int i, const float3& O, const float3& D, const float3& w, const uint p, const uint f )
+{
+	Ox[i] = O.x, Oy[i] = O.y, Oz[i] = O.z;
+	Dx[i] = D.x, Dy[i] = D.y, Dz[i] = D.z;
+	t[i] = 1e34f, tstart[i] = 0, weight[i] = w, pixel[i] = p, flags[i] = f;
+}
+
+void ConnectQueue::Resize( const int n )
+{
+	position.resize( n ), normal.resize( n ), albedo.resize( n ), weight.resize( n ), pixel.resize( n );
+}
+
+// -----------------------------------------------------------
+// Extend stage: find the nearest hit for every ray in the queue
+// -----------------------------------------------------------
+uint64_t Renderer::Extend( RayQueue& q, const bool packets )
+{
+	uint64_t steps = 0;
+	const int packetCount = packets ? q.count / 8 : 0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:steps)
+	for (int i = 0; i < packetCount; i++)
+	{
+		RayPacket8 packet;
+		const int first = i * 8;
+		memcpy( packet.Ox, &q.Ox[first], 32 ), memcpy( packet.Oy, &q.Oy[first], 32 ), memcpy( packet.Oz, &q.Oz[first], 32 );
+		memcpy( packet.Dx, &q.Dx[first], 32 ), memcpy( packet.Dy, &q.Dy[first], 32 ), memcpy( packet.Dz, &q.Dz[first], 32 );
+		memcpy( packet.t, &q.t[first], 32 ), memcpy( packet.tstart, &q.tstart[first], 32 );
+		memset( packet.voxel, 0, 32 ), memset( packet.axis, 0, 32 );
+		scene.FindNearest8( packet );
+		memcpy( &q.Ox[first], packet.Ox, 32 ), memcpy( &q.Oy[first], packet.Oy, 32 ), memcpy( &q.Oz[first], packet.Oz, 32 );
+		memcpy( &q.t[first], packet.t, 32 ), memcpy( &q.voxel[first], packet.voxel, 32 ), memcpy( &q.axis[first], packet.axis, 32 );
+		for (int lane = 0; lane < 8; lane++) steps += packet.steps[lane];
+	}
+	// remaining rays one by one
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:steps)
+	for (int i = packetCount * 8; i < q.count; i++)
+	{
+		Ray ray( float3( q.Ox[i], q.Oy[i], q.Oz[i] ), float3( q.Dx[i], q.Dy[i], q.Dz[i] ), q.t[i] );
+		ray.tstart = q.tstart[i];
+		scene.FindNearest( ray );
+		// FindNearest nudges the origin; keep it, so that O + t * D is the hit point
+		q.Ox[i] = ray.O.x, q.Oy[i] = ray.O.y, q.Oz[i] = ray.O.z;
+		q.t[i] = ray.t, q.voxel[i] = ray.voxel, q.axis[i] = ray.axis;
+		steps += ray.steps;
+	}
+	return steps;
+}
+
+// -----------------------------------------------------------
+// Connect stage for the waiting points [first, last), batched: collect their
+// shadow rays, sort them by light and direction octant, so that the rays of a
+// packet share a light (and, for a directional light, the exact direction),
+// then trace them 8 at a time. Visibility is stored per ray and gathered per
+// point in the order Connect produced the rays, so the sort does not change
+// the result. Returns the number of shadow rays.
+// -----------------------------------------------------------
+uint64_t Renderer::ConnectBatch( const int first, const int last, const bool packets )
+{
+	static thread_local vector<LightSet::ShadowRay> batch;
+	static thread_local vector<uint64_t> order;
+	static thread_local vector<uchar> visible;
+	static thread_local vector<int> firstRay; // per point: its first ray in 'batch'; -1 if cached
+	static thread_local vector<float3> light; // per point: the cached light
+	const int points = last - first;
+	batch.clear(), order.clear();
+	firstRay.resize( points + 1 ), light.assign( points, float3( 0 ) );
+	uint64_t cacheHits = 0;
+	for (int i = first; i < last; i++)
+	{
+		ShadingPoint sp;
+		sp.position = connectQueue.position[i];
+		sp.normal = connectQueue.normal[i];
+		sp.albedo = connectQueue.albedo[i];
+		sp.pixel = connectQueue.pixel[i];
+		if (useRadianceCache && radianceCache.Lookup( sp.position, sp.normal, light[i - first] ))
+		{
+			firstRay[i - first] = -1, cacheHits++;
+			continue;
+		}
+		firstRay[i - first] = (int)batch.size();
+		lights.Connect( sp, scene, sampleLights ? lightSamples : 0, batch );
+	}
+	firstRay[points] = (int)batch.size();
+	if (useRadianceCache) radianceCache.lookups += points, radianceCache.hits += cacheHits;
+	// sort key: light, then the sign bits of the direction, then the index in the batch;
+	// rays with a known visibility (t = 0) are not traced
+	visible.resize( batch.size() );
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		if (batch[i].t == 0) { visible[i] = 1; continue; }
+		const float3& D = batch[i].D;
+		const uint octant = (D.x < 0 ? 1 : 0) + (D.y < 0 ? 2 : 0) + (D.z < 0 ? 4 : 0);
+		order.push_back( (uint64_t)batch[i].light << 32 | (uint64_t)octant << 29 | i );
+	}
+	std::sort( order.begin(), order.end() );
+	const int count = (int)order.size();
+	if (!packets) for (int i = 0; i < count; i++)
+	{
+		const int idx = (int)(order[i] & 0x1fffffff);
+		const LightSet::ShadowRay& r = batch[idx];
+		Ray ray( r.O, r.D, r.t );
+		visible[idx] = !scene.IsOccluded( ray );
+	}
+	else for (int i = 0; i < count; i += 8)
+	{
+		// a partial last packet repeats its last ray
+		int idx[8];
+		for (int lane = 0; lane < 8; lane++) idx[lane] = (int)(order[min( i + lane, count - 1 )] & 0x1fffffff);
+		RayPacket8 packet;
+		for (int lane = 0; lane < 8; lane++)
+		{
+			const LightSet::ShadowRay& r = batch[idx[lane]];
+			packet.Ox[lane] = r.O.x, packet.Oy[lane] = r.O.y, packet.Oz[lane] = r.O.z;
+			packet.Dx[lane] = r.D.x, packet.Dy[lane] = r.D.y, packet.Dz[lane] = r.D.z;
+			packet.t[lane] = r.t;
+		}
+		const uint occluded = scene.IsOccluded8( packet );
+		for (int lane = 0; lane < min( 8, count - i ); lane++) visible[idx[lane]] = !(occluded & (1 << lane));
+	}
+	// gather the light per point; a path has one point per pass, so pixels don't collide
+	for (int p = 0; p < points; p++)
+	{
+		const int i = first + p;
+		float3 L = light[p];
+		if (firstRay[p] >= 0)
+		{
+			int end = p + 1;
+			while (firstRay[end] < 0) end++; // skip cached points; firstRay[points] ends the batch
+			L = LightSet::Gather( batch.data() + firstRay[p], visible.data() + firstRay[p], firstRay[end] - firstRay[p] );
+			if (useRadianceCache) radianceCache.Add( connectQueue.position[i], connectQueue.normal[i], L );
+		}
+		frameSample[connectQueue.pixel[i]] += connectQueue.weight[i] * L;
+	}
+	return count;
+}
+
+// -----------------------------------------------------------
+// Render one sample per (active) pixel with the wavefront pipeline; see wavefront.h.
+// Produces the same estimate as Trace for every pixel.
+// Returns the traversal steps taken by the primary rays; 'rays'
+// receives the number of rays traced (excluding shadow rays).
+// -----------------------------------------------------------
+uint64_t Renderer::RenderWavefront( const bool packets, uint64_t& rays )
+{
+	const int N = SCRWIDTH * SCRHEIGHT;
+	const float3 sky( 0.53f, 0.81f, 0.92f );
+	if ((int)frameSample.size() != N)
+	{
+		frameSample.resize( N );
+		rayQueue[0].Resize( N ), rayQueue[1].Resize( N ), connectQueue.Resize( N );
+	}
+	float ms[WF_STAGES] = {};
+	Timer timer;
+
+	// generate: one jittered camera ray per pixel; with adaptive sampling, per active pixel
+	RayQueue& primary = rayQueue[0];
+	const bool adaptive = adaptiveSampling;
+	const int count = adaptive ? (int)activePixels.size() : N;
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < count; i++)
+	{
+		const int idx = adaptive ? activePixels[i] : i, x = idx % SCRWIDTH, y = idx / SCRWIDTH;
+		const Ray r = camera.GetPrimaryRay( x + RandomFloat(), y + RandomFloat() );
+		primary.Set( i, r.O, r.D, float3( 1 ), idx, 0 ), primary.tstart[i] = BeamStart( x, y );
+		frameSample[idx] = float3( 0 );
+	}
+	primary.count = count;
+	ms[WF_GENERATE] = timer.elapsed() * 1000.0f;
+
+	uint64_t primarySteps = 0, shadowRays = 0;
+	rays = 0;
+	for (int depth = 0, current = 0; rayQueue[current].count > 0; depth++, current ^= 1)
+	{
+		RayQueue& in = rayQueue[current], & out = rayQueue[current ^ 1];
+
+		// extend
+		timer.reset();
+		const uint64_t steps = Extend( in, packets );
+		rays += in.count;
+		if (depth == 0) primarySteps = steps;
+		ms[WF_EXTEND] += timer.elapsed() * 1000.0f;
+
+		// shade: every path owns one pixel and has one ray per pass, so pixel writes don't collide
+		timer.reset();
+		std::atomic<int> outCount( 0 ), connectCount( 0 );
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < in.count; i++)
+		{
+			const uint voxel = in.voxel[i], pixel = in.pixel[i];
+			float3 weight = in.weight[i];
+			if (depth == 0 && recordHits) RecordHit( pixel, float3( in.Ox[i], in.Oy[i], in.Oz[i] ), float3( in.Dx[i], in.Dy[i], in.Dz[i] ), in.t[i], voxel, in.axis[i] );
+			if (voxel == 0 || voxel >= scene.materialCount) { frameSample[pixel] += weight * sky; continue; }
+			if (depth >= MAX_DEPTH) continue;
+			const Material& mat = scene.materials[voxel];
+			if (in.flags[i] & RayQueue::PENDING_ALBEDO) weight *= mat.albedo;
+			const float3 D( in.Dx[i], in.Dy[i], in.Dz[i] );
+			const float3 P = float3( in.Ox[i], in.Oy[i], in.Oz[i] ) + in.t[i] * D;
+			// voxel normal, as in Ray::GetNormal
+			const uint axis = in.axis[i];
+			float3 N( 0 );
+			N[axis] = std::signbit( D[axis] ) ? 1.0f : -1.0f;
+			if (debugNormals) { frameSample[pixel] += weight * 0.5f * (N + float3( 1.0f )); continue; }
+			switch (mat.type)
+			{
+			case MaterialType::Lambertian:
+			{
+				const int c = connectCount++;
+				connectQueue.position[c] = P, connectQueue.normal[c] = N, connectQueue.albedo[c] = mat.albedo;
+				connectQueue.weight[c] = weight * mat.albedo, connectQueue.pixel[c] = pixel;
+				break;
+			}
+			case MaterialType::Metal:
+			{
+				float3 R = normalize( D - 2.0f * dot( D, N ) * N );
+				if (mat.roughness > 0.0f) R += mat.roughness * RandomInUnitSphere();
+				out.Set( outCount++, P + N * EPSILON, normalize( R ), weight, pixel, RayQueue::PENDING_ALBEDO );
+				break;
+			}
+			case MaterialType::Dielectric:
+			{
+				float3 refracted;
+				const float ni_over_nt = dot( D, N ) > 0 ? mat.ior : 1.0f / mat.ior;
+				float reflect_prob = 1.0f;
+				if (Refract( D, N, ni_over_nt, refracted )) reflect_prob = Schlick( dot( D, N ), mat.ior );
+				if (RandomFloat() < reflect_prob) out.Set( outCount++, P + N * EPSILON, normalize( reflect( D, N ) ), weight, pixel, 0 );
+				else out.Set( outCount++, P - N * EPSILON, normalize( refracted ), weight, pixel, 0 );
+				break;
+			}
+			case MaterialType::Emissive:
+				frameSample[pixel] += weight * mat.emission * mat.emissionStr;
+				break;
+			}
+		}
+		out.count = outCount, connectQueue.count = connectCount;
+		ms[WF_SHADE] += timer.elapsed() * 1000.0f;
+
+		// connect: all lights for each waiting point; a path has one point per pass, so pixels don't collide
+		timer.reset();
+		if (batchShadows)
+		{
+			const int batches = (connectQueue.count + SHADOW_BATCH - 1) / SHADOW_BATCH;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:shadowRays)
+			for (int b = 0; b < batches; b++)
+				shadowRays += ConnectBatch( b * SHADOW_BATCH, min( (b + 1) * SHADOW_BATCH, connectQueue.count ), packets );
+		}
+		else
+		{
+#pragma omp parallel for schedule(dynamic, 256)
+			for (int i = 0; i < connectQueue.count; i++)
+			{
+				ShadingPoint sp;
+				sp.position = connectQueue.position[i];
+				sp.normal = connectQueue.normal[i];
+				sp.albedo = connectQueue.albedo[i];
+				sp.pixel = connectQueue.pixel[i];
+				frameSample[connectQueue.pixel[i]] += connectQueue.weight[i] * DirectLight( sp );
+			}
+		}
+		ms[WF_CONNECT] += timer.elapsed() * 1000.0f;
+	}
+
+	// accumulate and display
+	const float invSampleCount = 1.0f / sampleCount;
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < count; i++)
+	{
+		const int idx = adaptive ? activePixels[i] : i;
+		AddSample( idx, frameSample[idx] );
+		screen->pixels[idx] = RGBF32_to_RGB8( accumulator[idx] * invSampleCount );
+	}
+	for (int i = 0; i < WF_STAGES; i++) stageMs[i] = 0.9f * stageMs[i] + 0.1f * ms[i];
+	shadowRaysPerPixel = (float)shadowRays / N;
+	return primarySteps;
+}
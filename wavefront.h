@@ -0,0 +1,40 @@
+#pragma once
+
+// Wavefront path tracing: instead of following one path at a time through the recursive
+// Renderer::Trace, all paths of a frame advance together through a few stages, each a
+// tight parallel loop over a compacted queue:
+//   generate: one camera ray per pixel
+//   extend:   nearest intersection for every queued ray
+//   shade:    evaluate materials; queue bounce rays and points that need direct light
+//   connect:  evaluate the lights (and their shadow rays) for the queued points
+// extend, shade and connect repeat until no rays are left.
+
+namespace Tmpl8 {
+
+// rays in flight, in SoA layout; the extend stage fills in the hit data
+struct RayQueue
+{
+	enum { PENDING_ALBEDO = 1 };	// flag: scale by the albedo of the voxel this ray hits (metal)
+	void Resize( const int n );
+	void Set( const int i, const float3& O, const float3& D, const float3& weight, const uint pixel, const uint flags );
+	int count = 0;
+	std::vector<float> Ox, Oy, Oz;		// ray origins
+	std::vector<float> Dx, Dy, Dz;		// normalized ray directions
+	std::vector<float> t;				// distance to the nearest hit
+	std::vector<float> tstart;			// distance with nothing to hit (beam prepass), 0 after Set
+	std::vector<uint> voxel, axis;		// payload and plane of the hit; voxel is 0 for a miss
+	std::vector<float3> weight;			// path throughput up to this ray
+	std::vector<uint> pixel, flags;
+};
+
+// shading points waiting for direct light, in SoA layout
+struct ConnectQueue
+{
+	void Resize( const int n );
+	int count = 0;
+	std::vector<float3> position, normal, albedo;
+	std::vector<float3> weight;			// path throughput times the material albedo
+	std::vector<uint> pixel;
+};
+
+} // namespace Tmpl8